@@ -0,0 +1,170 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * arena.c
+ */
+
+#include "arena.h"
+
+#define ALIGN 16
+#define CHUNK 4096
+
+/**
+ * Chunks are singly linked, newest first; only the newest one is carved.
+ * A request that does not fit starts a new chunk of twice the previous
+ * one's size, so there are O(log n) chunks for n bytes and closing
+ * the arena costs one free() per chunk. Requests larger than the next
+ * chunk get a chunk of their own, linked behind the head so that carving
+ * continues where it was. The arena header itself lives in the first
+ * chunk, so a small parse costs a single malloc().
+ */
+
+struct chunk {
+	struct chunk *next;
+	size_t size; /* bytes of payload */
+	size_t used;
+	union {
+		long double ld;
+		void *p;
+		double d;
+		long l;
+	} payload[1];
+};
+
+struct arena {
+	struct chunk *head;
+};
+
+static size_t
+align(size_t n)
+{
+	return (n + (ALIGN - 1)) & ~(size_t)(ALIGN - 1);
+}
+
+static struct chunk *
+mkchunk(size_t size)
+{
+	struct chunk *chunk;
+
+	if (!(chunk = malloc(offsetof(struct chunk, payload) + size))) {
+		TRACE("out of memory");
+		return NULL;
+	}
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+struct arena *
+arena_open(void)
+{
+	struct arena *arena;
+	struct chunk *chunk;
+
+	if (!(chunk = mkchunk(CHUNK))) {
+		TRACE(0);
+		return NULL;
+	}
+	arena = (struct arena *)chunk->payload;
+	chunk->used = align(sizeof (struct arena));
+	arena->head = chunk;
+	return arena;
+}
+
+void
+arena_close(struct arena *arena)
+{
+	struct chunk *chunk, *next;
+
+	if (arena) {
+		/* the last chunk freed holds arena */
+		for (chunk=arena->head; chunk; chunk=next) {
+			next = chunk->next;
+			FREE(chunk);
+		}
+	}
+}
+
+void *
+arena_malloc(struct arena *arena, size_t n)
+{
+	struct chunk *chunk;
+	size_t size;
+	char *p;
+
+	assert( arena );
+
+	n = align(n ? n : 1);
+	if ((arena->head->size - arena->head->used) < n) {
+		size = 2 * arena->head->size;
+		if (size < n) {
+			/* oversized, a chunk of its own behind the head */
+			if (!(chunk = mkchunk(n))) {
+				TRACE(0);
+				return NULL;
+			}
+			chunk->used = n;
+			chunk->next = arena->head->next;
+			arena->head->next = chunk;
+			return chunk->payload;
+		}
+		if (!(chunk = mkchunk(size))) {
+			TRACE(0);
+			return NULL;
+		}
+		chunk->next = arena->head;
+		arena->head = chunk;
+	}
+	chunk = arena->head;
+	p = (char *)chunk->payload + chunk->used;
+	chunk->used += n;
+	return p;
+}
+
+void *
+arena_realloc(struct arena *arena, void *p, size_t m, size_t n)
+{
+	struct chunk *chunk;
+	void *q;
+
+	assert( arena );
+
+	/* the most recent allocation grows in place if its chunk has room */
+
+	chunk = arena->head;
+	if (p &&
+	    (n >= m) &&
+	    ((char *)p + align(m) == (char *)chunk->payload + chunk->used) &&
+	    ((align(n) - align(m)) <= (chunk->size - chunk->used))) {
+		chunk->used += align(n) - align(m);
+		return p;
+	}
+	if (!(q = arena_malloc(arena, n))) {
+		TRACE(0);
+		return NULL;
+	}
+	if (p) {
+		memcpy(q, p, (m < n) ? m : n);
+	}
+	return q;
+}
+
+char *
+arena_strndup(struct arena *arena, const char *s, size_t n)
+{
+	char *p;
+
+	assert( arena && s );
+
+	if (!(p = arena_malloc(arena, n + 1))) {
+		TRACE(0);
+		return NULL;
+	}
+	memcpy(p, s, n);
+	p[n] = '\0';
+	return p;
+}
@@ -0,0 +1,62 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * arena.h
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "system.h"
+
+struct arena;
+
+/**
+ * Creates a bump allocator. Memory is carved sequentially out of chunks
+ * that double in size, so objects allocated one after the other are
+ * mostly contiguous, and everything is released at once by arena_close().
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct arena *arena_open(void);
+
+/**
+ * Releases every allocation made from arena.
+ *
+ * Note: arena may be NULL
+ */
+
+void arena_close(struct arena *arena);
+
+/**
+ * Allocates n bytes, aligned for any object type. There is no individual
+ * free.
+ *
+ * return: the uninitialized memory or NULL on error
+ */
+
+void *arena_malloc(struct arena *arena, size_t n);
+
+/**
+ * Resizes an allocation of m bytes to n bytes. The most recent allocation
+ * grows in place when possible, otherwise the contents are copied and the
+ * old block is simply abandoned until arena_close().
+ *
+ * return: the resized memory or NULL on error (p is left untouched)
+ */
+
+void *arena_realloc(struct arena *arena, void *p, size_t m, size_t n);
+
+/**
+ * Copies the first n characters of s into the arena, NUL-terminated.
+ *
+ * return: the copy or NULL on error
+ */
+
+char *arena_strndup(struct arena *arena, const char *s, size_t n);
+
+#endif /* _ARENA_H_ */
@@ -0,0 +1,782 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * bench.c
+ */
+
+#include <math.h>
+#include "jitc.h"
+#include "lexer.h"
+#include "parser.h"
+#include "generate.h"
+#include "vm.h"
+#include "system.h"
+
+/**
+ * Phase-level latency of the JIT pipeline over a synthetic corpus, one
+ * line per (expression, phase) with the percentiles of the samples, as
+ * CSV or, with -j, as JSON lines. Built and run by "make bench". gcc is
+ * timed with the default -O3 -march=native profile and, as jitc_compile_O0,
+ * with the -O0 profile meant for throwaway expressions.
+ *
+ * The corpus crosses expression size with three shapes of the same leaf
+ * count: balanced (random split, depth ~ log n), chain (a left-deep
+ * a+b+c+..., depth n, no parentheses) and nested (right-deep, one pair of
+ * parentheses per operator). A second, deep corpus of about 1M tokens per
+ * expression (chain, nested and a run of unary '-') only goes through
+ * the front end and generate(), gcc would take minutes on it. Finally,
+ * a batch of JOBS balanced expressions is compiled by jitc_compile_many()
+ * with 1 and then POOL concurrent compilers, reported per job.
+ *
+ * Next to evaluate, vm_evaluate times the bytecode VM on the same calls
+ * and vm_saving the difference, in picoseconds per VM instruction; its
+ * nodes column holds the instruction count. With jitc_compile, these are
+ * the inputs of worth_compiling() in main.c.
+ *
+ * Before anything is timed, every expression of EDGES is evaluated by the
+ * VM, by jitc_emit() and by gcc, and the run fails unless all three agree.
+ */
+
+#define VARS 4
+#define ROWS 65536
+#define CALLS 10000
+
+#define JOBS 16
+#define POOL 4
+
+#define CFILE "bench_out.c"
+#define DAGFILE "bench_out.dag"
+#define SOFILE "./bench_out.so"
+#define JOBFILE "bench_job%d.%s"
+
+enum shape { BALANCED, CHAIN, NESTED, UNARY };
+
+static const char * const SHAPES[] = { "balanced", "chain", "nested", "unary" };
+
+/* constants the backends have spelled differently, over a=1, b=2, ... */
+
+static const char * const EDGES[] = {
+	"pow(-(0)*a,-1)", /* folds to -0.0, %g wrote "-0" */
+	"1/(-(0)*a)",
+	"-(0)*a+1/b",
+	"1/(a-a)",
+	"sqrt(-(a))",
+	"exp(1000*a)-exp(1000*b)"
+};
+
+static const int LEAVES[] = { 8, 64, 512 };
+
+static const struct {
+	enum shape shape;
+	int leaves;
+} DEEP[] = {
+	{ CHAIN, 500000 },  /* x+y*z..., 2 tokens per leaf */
+	{ NESTED, 250000 }, /* (x+(y*(z..., 4 tokens per leaf */
+	{ UNARY, 1000000 }  /* - - - ... x */
+};
+
+typedef double (*evaluate_t)(const double *vars);
+
+typedef void (*evaluate_batch_t)(const double *const *cols,
+				 double *out,
+				 size_t n);
+
+typedef double (*evaluate_grad_t)(const double *vars, double *grad);
+
+static const struct jitc_options QUICK = {
+	0, 0, 0, NULL, NULL, JITC_PGO_NONE, NULL
+};
+
+static double sink; /* keeps the calls from being optimized away */
+
+struct text {
+	char *buf;
+	size_t size;
+	size_t capacity;
+};
+
+static int
+append(struct text *text, const char *s)
+{
+	size_t n, m;
+	char *buf;
+
+	n = safe_strlen(s);
+	if ((text->size + n + 1) > text->capacity) {
+		m = text->capacity ? (2 * text->capacity) : 256;
+		while (m < (text->size + n + 1)) {
+			m *= 2;
+		}
+		if (!(buf = realloc(text->buf, m))) {
+			TRACE("out of memory");
+			return -1;
+		}
+		text->buf = buf;
+		text->capacity = m;
+	}
+	memcpy(text->buf + text->size, s, n + 1);
+	text->size += n;
+	return 0;
+}
+
+static const char *
+leaf(char *buf, size_t len)
+{
+	if (rand() % 2) {
+		safe_sprintf(buf, len, "x%d", rand() % VARS);
+	}
+	else {
+		safe_sprintf(buf, len, "%d.%d", 1 + rand() % 9, rand() % 10);
+	}
+	return buf;
+}
+
+static const char *
+operator(void)
+{
+	static const char * const OPS[] = { "+", "-", "*", "/" };
+
+	return OPS[rand() % ARRAY_SIZE(OPS)];
+}
+
+/**
+ * Appends an expression of n leaves (operators, for unary) to text and
+ * returns its nesting depth in operators, or -1 on error. Only balanced
+ * recurses, to a depth of about log n.
+ */
+
+static int
+expression(struct text *text, enum shape shape, int n)
+{
+	char buf[32];
+	int i, l, r;
+
+	if (1 == n) {
+		return append(text, leaf(buf, sizeof (buf))) ? -1 : 0;
+	}
+	if (CHAIN == shape) {
+		if (append(text, leaf(buf, sizeof (buf)))) {
+			return -1;
+		}
+		for (i=1; i<n; ++i) {
+			if (append(text, operator()) ||
+			    append(text, leaf(buf, sizeof (buf)))) {
+				return -1;
+			}
+		}
+		return n - 1;
+	}
+	if (NESTED == shape) {
+		for (i=1; i<n; ++i) {
+			if (append(text, "(") ||
+			    append(text, leaf(buf, sizeof (buf))) ||
+			    append(text, operator())) {
+				return -1;
+			}
+		}
+		if (append(text, leaf(buf, sizeof (buf)))) {
+			return -1;
+		}
+		for (i=1; i<n; ++i) {
+			if (append(text, ")")) {
+				return -1;
+			}
+		}
+		return n - 1;
+	}
+	if (UNARY == shape) {
+		for (i=1; i<n; ++i) {
+			if (append(text, "-")) {
+				return -1;
+			}
+		}
+		return append(text, leaf(buf, sizeof (buf))) ? -1 : (n - 1);
+	}
+	l = 1 + rand() % (n - 1);
+	if (append(text, "(") ||
+	    (0 > (i = expression(text, shape, l))) ||
+	    append(text, operator()) ||
+	    (0 > (r = expression(text, shape, n - l))) ||
+	    append(text, ")")) {
+		return -1;
+	}
+	return 1 + ((i > r) ? i : r);
+}
+
+static int
+compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t
+percentile(const uint64_t *samples, int n, int p)
+{
+	return samples[((n - 1) * p + 50) / 100];
+}
+
+/**
+ * Prints one result line. samples are sorted in place.
+ */
+
+static void
+report(int json,
+       enum shape shape,
+       int leaves,
+       uint64_t nodes,
+       int depth,
+       const char *phase,
+       const char *unit,
+       uint64_t *samples,
+       int n)
+{
+	qsort(samples, n, sizeof (samples[0]), compare);
+	printf(json ?
+	       "{\"shape\":\"%s\",\"leaves\":%d,\"nodes\":%lu,\"depth\":%d,"
+	       "\"phase\":\"%s\",\"unit\":\"%s\",\"samples\":%d,"
+	       "\"min\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu}\n" :
+	       "%s,%d,%lu,%d,%s,%s,%d,%lu,%lu,%lu,%lu,%lu\n",
+	       SHAPES[shape],
+	       leaves,
+	       (unsigned long)nodes,
+	       depth,
+	       phase,
+	       unit,
+	       n,
+	       (unsigned long)samples[0],
+	       (unsigned long)percentile(samples, n, 50),
+	       (unsigned long)percentile(samples, n, 90),
+	       (unsigned long)percentile(samples, n, 99),
+	       (unsigned long)samples[n - 1]);
+	fflush(stdout);
+}
+
+static int
+source(void *arg, FILE *file)
+{
+	const struct parser *parsers[1];
+
+	parsers[0] = (const struct parser *)arg;
+	return generate(parsers, 1, 1, file);
+}
+
+static double
+final(double x)
+{
+	return 1.0 / (1.0 + exp(-x));
+}
+
+/**
+ * Evaluates s with the VM, with jitc_emit() and with a gcc module.
+ *
+ * return: 0 if all three agree (NaN agrees with NaN), otherwise -1
+ */
+
+static int
+agree(const char *s)
+{
+	double vars[VARS], y[3];
+	struct parser *parser;
+	struct jitc *x64, *gcc;
+	evaluate_t fnc;
+	struct vm *vm;
+	int i;
+
+	for (i=0; i<VARS; ++i) {
+		vars[i] = 1.0 + i;
+	}
+	if (!(parser = parser_open(s)) || parser_optimize(parser, 0)) {
+		parser_close(parser);
+		TRACE(0);
+		return -1;
+	}
+	vm = vm_open(parser, final);
+	x64 = jitc_emit(parser, final);
+	gcc = jitc_compile_memory(source, parser, &QUICK);
+	parser_close(parser);
+	if (!vm || !x64 || !gcc) {
+		vm_close(vm);
+		jitc_close(x64);
+		jitc_close(gcc);
+		TRACE(0);
+		return -1;
+	}
+	y[0] = vm_evaluate(vm, vars);
+	fnc = (evaluate_t)jitc_lookup(x64, "evaluate");
+	y[1] = fnc(vars);
+	fnc = (evaluate_t)jitc_lookup(gcc, "evaluate");
+	y[2] = fnc(vars);
+	vm_close(vm);
+	jitc_close(x64);
+	jitc_close(gcc);
+	for (i=1; i<3; ++i) {
+		if ((y[0] != y[i]) && ((y[0] == y[0]) || (y[i] == y[i]))) {
+			fprintf(stderr,
+				"%s: vm %.17g, x64 %.17g, gcc %.17g\n",
+				s,
+				y[0],
+				y[1],
+				y[2]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * The gradient the way it is taken without evaluate_grad(): forward
+ * differences, VARS + 1 calls of fnc. Returns fnc(vars).
+ */
+
+static double
+difference(evaluate_t fnc, double *vars, double *dx)
+{
+	const double H = 1e-6;
+	double y, x;
+	int k;
+
+	y = fnc(vars);
+	for (k=0; k<VARS; ++k) {
+		x = vars[k];
+		vars[k] = x + H;
+		dx[k] = (fnc(vars) - y) / H;
+		vars[k] = x;
+	}
+	return y;
+}
+
+/**
+ * Runs every phase on one expression, or only up to generate() without
+ * native set. Cheap phases are sampled more often than gcc, and evaluate
+ * is reported per call (scalar) and per row (batch), each sample
+ * averaging many calls to get above timer noise. parser_load reads the
+ * expression back from parser_save(), as a restart would. The gradient
+ * is timed per call, as evaluate_grad and as forward differences
+ * (evaluate_fd).
+ */
+
+static int
+run(int json,
+    enum shape shape,
+    int leaves,
+    int depth,
+    const char *s,
+    int native)
+{
+	const int SAMPLES = native ? 101 : 5, COMPILES = 5;
+	const struct parser *parsers[1];
+	uint64_t samples[101], t, u, nodes;
+	evaluate_batch_t batch;
+	evaluate_grad_t grad;
+	struct parser *parser, *loaded;
+	struct lexer *lexer;
+	struct jitc *jitc, *gradient;
+	evaluate_t fnc;
+	double *cols[VARS], *out, vars[VARS], dx[VARS], sum;
+	struct vm *vm;
+	FILE *file;
+	int i, j;
+
+	if (!(parser = parser_open(s))) {
+		TRACE(0);
+		return -1;
+	}
+	nodes = parser_size(parser);
+	parser_close(parser);
+
+	/* lexer_open */
+
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		if (!(lexer = lexer_open(s, NULL))) {
+			TRACE(0);
+			return -1;
+		}
+		samples[i] = time_ns() - t;
+		lexer_close(lexer);
+	}
+	report(json, shape, leaves, nodes, depth, "lexer_open", "ns",
+	       samples, SAMPLES);
+
+	/* parser_open, lexer included */
+
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		if (!(parser = parser_open(s))) {
+			TRACE(0);
+			return -1;
+		}
+		samples[i] = time_ns() - t;
+		parser_close(parser);
+	}
+	if (!(parser = parser_open(s))) {
+		TRACE(0);
+		return -1;
+	}
+	report(json, shape, leaves, nodes, depth, "parser_open", "ns",
+	       samples, SAMPLES);
+
+	/* parser_load, the same DAG from its binary form */
+
+	if (parser_save(parser, DAGFILE)) {
+		parser_close(parser);
+		TRACE(0);
+		return -1;
+	}
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		if (!(loaded = parser_load(DAGFILE))) {
+			parser_close(parser);
+			TRACE(0);
+			return -1;
+		}
+		samples[i] = time_ns() - t;
+		parser_close(loaded);
+	}
+	file_delete(DAGFILE);
+	report(json, shape, leaves, nodes, depth, "parser_load", "ns",
+	       samples, SAMPLES);
+
+	/* generate */
+
+	parsers[0] = parser;
+	for (i=0; i<SAMPLES; ++i) {
+		if (!(file = fopen(CFILE, "w"))) {
+			parser_close(parser);
+			TRACE("fopen()");
+			return -1;
+		}
+		t = time_ns();
+		if (generate(parsers, 1, 0, file)) {
+			fclose(file);
+			parser_close(parser);
+			TRACE(0);
+			return -1;
+		}
+		fflush(file);
+		samples[i] = time_ns() - t;
+		fclose(file);
+	}
+	report(json, shape, leaves, nodes, depth, "generate", "ns",
+	       samples, SAMPLES);
+	if (!native) {
+		parser_close(parser);
+		return 0;
+	}
+
+	/* jitc_compile, -O0 first so that the -O3 module is the one run */
+
+	for (i=0; i<COMPILES; ++i) {
+		t = time_ns();
+		if (jitc_compile(CFILE, SOFILE, &QUICK)) {
+			parser_close(parser);
+			TRACE(0);
+			return -1;
+		}
+		samples[i] = time_ns() - t;
+	}
+	report(json, shape, leaves, nodes, depth, "jitc_compile_O0", "ns",
+	       samples, COMPILES);
+	for (i=0; i<COMPILES; ++i) {
+		t = time_ns();
+		if (jitc_compile(CFILE, SOFILE, NULL)) {
+			parser_close(parser);
+			TRACE(0);
+			return -1;
+		}
+		samples[i] = time_ns() - t;
+	}
+	report(json, shape, leaves, nodes, depth, "jitc_compile", "ns",
+	       samples, COMPILES);
+
+	/* jitc_open + jitc_lookup, unloaded in between */
+
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		if (!(jitc = jitc_open(SOFILE)) ||
+		    !jitc_lookup(jitc, "evaluate") ||
+		    !jitc_lookup(jitc, "evaluate_batch")) {
+			jitc_close(jitc);
+			parser_close(parser);
+			TRACE(0);
+			return -1;
+		}
+		samples[i] = time_ns() - t;
+		jitc_close(jitc);
+	}
+	report(json, shape, leaves, nodes, depth, "jitc_open", "ns",
+	       samples, SAMPLES);
+
+	/* the same expression with evaluate_grad(), kept out of the above */
+
+	gradient = jitc_compile_memory(source, parser, NULL);
+	vm = vm_open(parser, final);
+	parser_close(parser);
+	if (!gradient || !vm) {
+		jitc_close(gradient);
+		vm_close(vm);
+		TRACE(0);
+		return -1;
+	}
+
+	/* evaluate */
+
+	if (!(jitc = jitc_open(SOFILE))) {
+		jitc_close(gradient);
+		vm_close(vm);
+		TRACE(0);
+		return -1;
+	}
+	fnc = (evaluate_t)jitc_lookup(jitc, "evaluate");
+	batch = (evaluate_batch_t)jitc_lookup(jitc, "evaluate_batch");
+	grad = (evaluate_grad_t)jitc_lookup(gradient, "evaluate_grad");
+	for (i=0; i<VARS; ++i) {
+		vars[i] = 1.0 + i;
+	}
+	for (i=0, sum=0.0; i<SAMPLES; ++i) {
+		t = time_ns();
+		for (j=0; j<CALLS; ++j) {
+			vars[0] = j;
+			sum += fnc(vars);
+		}
+		samples[i] = (time_ns() - t) / CALLS;
+	}
+	report(json, shape, leaves, nodes, depth, "evaluate", "ns/call",
+	       samples, SAMPLES);
+
+	/* the VM, and what native code saves per VM instruction, which with
+	   jitc_compile gives the constants of worth_compiling() in main.c */
+
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		for (j=0; j<CALLS; ++j) {
+			vars[0] = j;
+			sum += vm_evaluate(vm, vars);
+		}
+		samples[i] = (time_ns() - t) / CALLS;
+	}
+	report(json, shape, leaves, nodes, depth, "vm_evaluate", "ns/call",
+	       samples, SAMPLES);
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		for (j=0; j<CALLS; ++j) {
+			vars[0] = j;
+			sum += fnc(vars);
+		}
+		t = time_ns() - t;
+		u = time_ns();
+		for (j=0; j<CALLS; ++j) {
+			vars[0] = j;
+			sum += vm_evaluate(vm, vars);
+		}
+		u = time_ns() - u;
+		samples[i] = (u > t) ? ((u - t) * 1000 / (CALLS * vm_size(vm))) : 0;
+	}
+	report(json, shape, leaves, vm_size(vm), depth, "vm_saving", "ps/insn",
+	       samples, SAMPLES);
+	vm_close(vm);
+
+	/* the gradient: compiled adjoints vs forward differences */
+
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		for (j=0; j<CALLS; ++j) {
+			vars[0] = j;
+			sum += grad(vars, dx);
+		}
+		samples[i] = (time_ns() - t) / CALLS;
+	}
+	report(json, shape, leaves, nodes, depth, "evaluate_grad", "ns/call",
+	       samples, SAMPLES);
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		for (j=0; j<CALLS; ++j) {
+			vars[0] = j;
+			sum += difference(fnc, vars, dx);
+		}
+		samples[i] = (time_ns() - t) / CALLS;
+	}
+	report(json, shape, leaves, nodes, depth, "evaluate_fd", "ns/call",
+	       samples, SAMPLES);
+	memset(cols, 0, sizeof (cols));
+	out = malloc(ROWS * sizeof (out[0]));
+	for (i=0; out && (i<VARS); ++i) {
+		if (!(cols[i] = malloc(ROWS * sizeof (double)))) {
+			break;
+		}
+		for (j=0; j<ROWS; ++j) {
+			cols[i][j] = (double)(j % 97) - i;
+		}
+	}
+	if (!out || (i < VARS)) {
+		for (i=0; i<VARS; ++i) {
+			FREE(cols[i]);
+		}
+		FREE(out);
+		jitc_close(jitc);
+		jitc_close(gradient);
+		TRACE("out of memory");
+		return -1;
+	}
+
+	/* picoseconds, batch rows take well under a nanosecond */
+
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		batch((const double *const *)cols, out, ROWS);
+		samples[i] = (time_ns() - t) * 1000 / ROWS;
+		sum += out[i];
+	}
+	report(json, shape, leaves, nodes, depth, "evaluate_batch", "ps/row",
+	       samples, SAMPLES);
+	for (i=0; i<VARS; ++i) {
+		FREE(cols[i]);
+	}
+	FREE(out);
+	jitc_close(jitc);
+	jitc_close(gradient);
+	sink = sum;
+	return 0;
+}
+
+/**
+ * Times jitc_compile_many() over JOBS files of balanced expressions of
+ * leaves leaves, serially and with a pool of k = POOL compilers.
+ */
+
+static int
+compile_many(int json, int leaves)
+{
+	const int SAMPLES = 3;
+	char inputs[JOBS][32], outputs[JOBS][32], phase[32];
+	struct jitc_job jobs[JOBS];
+	const struct parser *parsers[1];
+	uint64_t samples[3], t;
+	struct parser *parser;
+	struct text text;
+	FILE *file;
+	int i, k, rc;
+
+	rc = 0;
+	for (i=0; i<JOBS; ++i) {
+		safe_sprintf(inputs[i], sizeof (inputs[i]), JOBFILE, i, "c");
+		safe_sprintf(outputs[i], sizeof (outputs[i]), "./" JOBFILE, i, "so");
+		jobs[i].input = inputs[i];
+		jobs[i].output = outputs[i];
+		jobs[i].options = NULL;
+		memset(&text, 0, sizeof (struct text));
+		if ((0 > expression(&text, BALANCED, leaves)) ||
+		    !(parser = parser_open(text.buf))) {
+			FREE(text.buf);
+			TRACE(0);
+			return -1;
+		}
+		FREE(text.buf);
+		parsers[0] = parser;
+		if (!(file = fopen(inputs[i], "w"))) {
+			parser_close(parser);
+			TRACE("fopen()");
+			return -1;
+		}
+		rc = generate(parsers, 1, 0, file);
+		fclose(file);
+		parser_close(parser);
+		if (rc) {
+			TRACE(0);
+			return -1;
+		}
+	}
+	for (k=1; k<=POOL; k*=POOL) {
+		for (i=0; i<SAMPLES; ++i) {
+			t = time_ns();
+			if (jitc_compile_many(jobs, JOBS, k)) {
+				TRACE(0);
+				rc = -1;
+				break;
+			}
+			samples[i] = (time_ns() - t) / JOBS;
+		}
+		if (rc) {
+			break;
+		}
+		safe_sprintf(phase, sizeof (phase), "jitc_compile_many_k%d", k);
+		report(json, BALANCED, leaves, 0, 0, phase, "ns/job",
+		       samples, SAMPLES);
+	}
+	for (i=0; i<JOBS; ++i) {
+		file_delete(inputs[i]);
+		file_delete(outputs[i]);
+	}
+	return rc;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct text text;
+	int json, depth;
+	size_t i, j;
+
+	json = (1 < argc) && !strcmp(argv[1], "-j");
+	if (!json) {
+		printf("shape,leaves,nodes,depth,phase,unit,samples,"
+		       "min,p50,p90,p99,max\n");
+	}
+	for (i=0; i<ARRAY_SIZE(EDGES); ++i) {
+		if (agree(EDGES[i])) {
+			TRACE(0);
+			return -1;
+		}
+	}
+	srand(238);
+	for (i=0; i<ARRAY_SIZE(LEAVES); ++i) {
+		for (j=0; j<=NESTED; ++j) {
+			memset(&text, 0, sizeof (struct text));
+			depth = expression(&text, (enum shape)j, LEAVES[i]);
+			if ((0 > depth) ||
+			    run(json,
+				(enum shape)j,
+				LEAVES[i],
+				depth,
+				text.buf,
+				1)) {
+				FREE(text.buf);
+				file_delete(CFILE);
+				file_delete(SOFILE);
+				TRACE(0);
+				return -1;
+			}
+			FREE(text.buf);
+		}
+	}
+	for (i=0; i<ARRAY_SIZE(DEEP); ++i) {
+		memset(&text, 0, sizeof (struct text));
+		depth = expression(&text, DEEP[i].shape, DEEP[i].leaves);
+		if ((0 > depth) ||
+		    run(json,
+			DEEP[i].shape,
+			DEEP[i].leaves,
+			depth,
+			text.buf,
+			0)) {
+			FREE(text.buf);
+			file_delete(CFILE);
+			TRACE(0);
+			return -1;
+		}
+		FREE(text.buf);
+	}
+	file_delete(CFILE);
+	file_delete(SOFILE);
+	if (compile_many(json, LEAVES[1])) {
+		TRACE(0);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,464 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * generate.c
+ */
+
+#include "generate.h"
+#include "range.h"
+
+#define BATCH_BLOCK 1024
+
+/**
+ * C spelling of the calls, indexed by op - PARSER_DAG_EXP. gcc expands
+ * the builtins inline where it can, e.g. sqrtsd and andpd, and otherwise
+ * calls libm directly; the *_() helpers are defined by generate().
+ */
+
+static const char * const FUNCTIONS[] = {
+	"__builtin_exp",
+	"__builtin_log",
+	"__builtin_sqrt",
+	"__builtin_fabs",
+	"sigmoid_",
+	"__builtin_pow",
+	"min_",
+	"max_"
+};
+
+/**
+ * Emits the temporary of one node, whose operands were emitted before
+ * (see parser_order()). A division whose divisor is proven non-zero (see
+ * range_open()) is a plain divide. Any other is guarded: with batch set,
+ * variables are read from the per-row columns c<var>[i] and the guard is
+ * div_() (see generate()), which keeps the loop vectorizable; the scalar
+ * code keeps the branch, which predicts well and, unlike div_(), adds
+ * nothing to the latency of the divide.
+ */
+
+static void
+reflect(const struct parser_dag *dag,
+	const struct range *range,
+	FILE *file,
+	int batch)
+{
+	if ((PARSER_DAG_VAL == dag->op) && (dag->val != dag->val)) {
+		fprintf(file,
+			"double t%d = __builtin_nan(\"\");\n",
+			dag->id);
+	}
+	else if ((PARSER_DAG_VAL == dag->op) && (0.0 != (dag->val - dag->val))) {
+		/* folded to infinity, which %g prints as "inf" */
+		fprintf(file,
+			"double t%d = %s__builtin_inf();\n",
+			dag->id,
+			(0.0 > dag->val) ? "-" : "");
+	}
+	else if ((PARSER_DAG_VAL == dag->op) &&
+		 (0.0 == dag->val) &&
+		 (0.0 > (1.0 / dag->val))) {
+		/* folded to -0.0, which %g prints as "-0", an int that negates to +0 */
+		fprintf(file, "double t%d = -0.0;\n", dag->id);
+	}
+	else if (PARSER_DAG_VAL == dag->op) {
+		fprintf(file,
+			"double t%d = %.17g;\n",
+			dag->id,
+			dag->val);
+	}
+	else if ((PARSER_DAG_VAR == dag->op) && batch) {
+		fprintf(file,
+			"double t%d = c%d[i];\n",
+			dag->id,
+			dag->var);
+	}
+	else if (PARSER_DAG_VAR == dag->op) {
+		fprintf(file,
+			"double t%d = vars[%d];\n",
+			dag->id,
+			dag->var);
+	}
+	else if (PARSER_DAG_NEG == dag->op) {
+		fprintf(file,
+			"double t%d = - t%d;\n",
+			dag->id,
+			dag->right->id);
+	}
+	else if (PARSER_DAG_MUL == dag->op) {
+		fprintf(file,
+			"double t%d = t%d * t%d;\n",
+			dag->id,
+			dag->left->id,
+			dag->right->id);
+	}
+	else if ((PARSER_DAG_DIV == dag->op) &&
+		 range_nonzero(range, dag->right)) {
+		fprintf(file,
+			"double t%d = t%d / t%d;\n",
+			dag->id,
+			dag->left->id,
+			dag->right->id);
+	}
+	else if ((PARSER_DAG_DIV == dag->op) && batch) {
+		fprintf(file,
+			"double t%d = div_(t%d, t%d);\n",
+			dag->id,
+			dag->left->id,
+			dag->right->id);
+	}
+	else if (PARSER_DAG_DIV == dag->op) {
+		fprintf(file,
+			"double t%d = t%d ? (t%d / t%d) : 0.0;\n",
+			dag->id,
+			dag->right->id,
+			dag->left->id,
+			dag->right->id);
+	}
+	else if (PARSER_DAG_ADD == dag->op) {
+		fprintf(file,
+			"double t%d = t%d + t%d;\n",
+			dag->id,
+			dag->left->id,
+			dag->right->id);
+	}
+	else if (PARSER_DAG_SUB == dag->op) {
+		fprintf(file,
+			"double t%d = t%d - t%d;\n",
+			dag->id,
+			dag->left->id,
+			dag->right->id);
+	}
+	else if ((PARSER_DAG_EXP <= dag->op) && !dag->left) {
+		fprintf(file,
+			"double t%d = %s(t%d);\n",
+			dag->id,
+			FUNCTIONS[dag->op - PARSER_DAG_EXP],
+			dag->right->id);
+	}
+	else if (PARSER_DAG_EXP <= dag->op) {
+		fprintf(file,
+			"double t%d = %s(t%d, t%d);\n",
+			dag->id,
+			FUNCTIONS[dag->op - PARSER_DAG_EXP],
+			dag->left->id,
+			dag->right->id);
+	}
+	else {
+		EXIT("software");
+	}
+}
+
+/**
+ * Emits the reverse-mode step of one node: its adjoint a<id> is complete
+ * (every parent has a larger id and was visited first), so it is added
+ * into the adjoints of its operands, times the local partial derivatives,
+ * which read the forward temporaries. Constant operands get no adjoint.
+ * The derivatives follow the forward code: a zero divisor yields 0 (and
+ * is only tested for where range cannot rule it out), abs()
+ * has slope 0 at 0 and min/max pass the adjoint to the operand they
+ * select.
+ */
+
+static void
+adjoint(const struct parser_dag *dag, const struct range *range, FILE *file)
+{
+	int n, x, y, l, r, g;
+	char c;
+
+	n = dag->id;
+	x = dag->left ? dag->left->id : 0;
+	y = dag->right ? dag->right->id : 0;
+	l = x && (PARSER_DAG_VAL != dag->left->op);
+	r = y && (PARSER_DAG_VAL != dag->right->op);
+	c = (PARSER_DAG_MIN == dag->op) ? '<' : '>';
+	if (PARSER_DAG_VAR == dag->op) {
+		fprintf(file, "grad[%d] = a%d;\n", dag->var, n);
+	}
+	else if (!l && !r) {
+		/* nothing depends on a variable */
+	}
+	else if (PARSER_DAG_NEG == dag->op) {
+		fprintf(file, "a%d -= a%d;\n", y, n);
+	}
+	else if (PARSER_DAG_MUL == dag->op) {
+		if (l) {
+			fprintf(file, "a%d += a%d * t%d;\n", x, n, y);
+		}
+		if (r) {
+			fprintf(file, "a%d += a%d * t%d;\n", y, n, x);
+		}
+	}
+	else if (PARSER_DAG_DIV == dag->op) {
+		g = !range_nonzero(range, dag->right);
+		if (g) {
+			fprintf(file, "if (t%d) {\n", y);
+		}
+		if (l) {
+			fprintf(file, "a%d += a%d / t%d;\n", x, n, y);
+		}
+		if (r) {
+			fprintf(file, "a%d -= a%d * t%d / t%d;\n", y, n, n, y);
+		}
+		if (g) {
+			fprintf(file, "}\n");
+		}
+	}
+	else if ((PARSER_DAG_ADD == dag->op) || (PARSER_DAG_SUB == dag->op)) {
+		if (l) {
+			fprintf(file, "a%d += a%d;\n", x, n);
+		}
+		if (r) {
+			fprintf(file,
+				"a%d %c= a%d;\n",
+				y,
+				(PARSER_DAG_ADD == dag->op) ? '+' : '-',
+				n);
+		}
+	}
+	else if (PARSER_DAG_EXP == dag->op) {
+		fprintf(file, "a%d += a%d * t%d;\n", y, n, n);
+	}
+	else if (PARSER_DAG_LOG == dag->op) {
+		fprintf(file, "a%d += a%d / t%d;\n", y, n, y);
+	}
+	else if (PARSER_DAG_SQRT == dag->op) {
+		fprintf(file, "a%d += a%d * 0.5 / t%d;\n", y, n, n);
+	}
+	else if (PARSER_DAG_ABS == dag->op) {
+		fprintf(file,
+			"a%d += (t%d < 0.0) ? - a%d"
+			" : ((t%d > 0.0) ? a%d : 0.0);\n",
+			y,
+			y,
+			n,
+			y,
+			n);
+	}
+	else if (PARSER_DAG_SIGMOID == dag->op) {
+		fprintf(file, "a%d += a%d * t%d * (1.0 - t%d);\n", y, n, n, n);
+	}
+	else if (PARSER_DAG_POW == dag->op) {
+		if (l) {
+			fprintf(file,
+				"a%d += a%d * t%d"
+				" * __builtin_pow(t%d, t%d - 1.0);\n",
+				x,
+				n,
+				y,
+				x,
+				y);
+		}
+		if (r) {
+			/* x^y log x, 0 where log x is not real */
+			fprintf(file,
+				"a%d += (t%d > 0.0)"
+				" ? (a%d * t%d * __builtin_log(t%d)) : 0.0;\n",
+				y,
+				x,
+				n,
+				n,
+				x);
+		}
+	}
+	else if ((PARSER_DAG_MIN == dag->op) || (PARSER_DAG_MAX == dag->op)) {
+		if (l) {
+			fprintf(file, "a%d += (t%d %c t%d) ? a%d : 0.0;\n",
+				x, x, c, y, n);
+		}
+		if (r) {
+			fprintf(file, "a%d += (t%d %c t%d) ? 0.0 : a%d;\n",
+				y, x, c, y, n);
+		}
+	}
+	else {
+		EXIT("software");
+	}
+}
+
+/**
+ * Emits evaluate_grad<suffix>(), which returns what evaluate<suffix>()
+ * does and stores its partial derivative with respect to vars[k] in
+ * grad[k], for every k in the symbol table. The forward pass is the one
+ * of evaluate(), one temporary per node, followed by a single reverse
+ * sweep over the same nodes, so all partials cost about two evaluations
+ * whatever the number of variables.
+ */
+
+static void
+generate_grad(const struct parser *parser,
+	      const struct range *range,
+	      const struct parser_dag **nodes,
+	      uint64_t m,
+	      const char *suffix,
+	      FILE *file)
+{
+	const struct parser_dag *dag;
+	uint64_t i, k;
+
+	dag = parser_dag(parser);
+	fprintf(file,
+		"double evaluate_grad%s(const double *vars, double *grad) {\n",
+		suffix);
+	fprintf(file, "(void)vars;\n(void)grad;\n");
+	for (i=0; i<m; ++i) {
+		reflect(nodes[i], range, file, 0);
+	}
+	fprintf(file, "double s = sigmoid_(t%d);\n", dag->id);
+	for (i=0; i<m; ++i) {
+		fprintf(file, "double a%d = 0.0;\n", nodes[i]->id);
+	}
+	fprintf(file, "a%d = s * (1.0 - s);\n", dag->id);
+	for (k=0; k<parser_symbol_size(parser); ++k) {
+		fprintf(file, "grad[%lu] = 0.0;\n", (unsigned long)k);
+	}
+	for (i=m; i; --i) {
+		adjoint(nodes[i - 1], range, file);
+	}
+	fprintf(file, "return s;\n}\n");
+}
+
+/**
+ * Emits the scalar entry point evaluate<suffix>(), with grad set its
+ * gradient (see generate_grad()), and the batch kernel
+ * evaluate_batch<suffix>(), which computes out[i] for n rows of columnar
+ * input. The batch loop is blocked so that the sigmoid_() pass, whose
+ * exp() stays a libm call, re-reads each block from cache, leaving the
+ * arithmetic loop free of calls and therefore vectorizable (unless the
+ * expression itself calls exp, log or pow).
+ */
+
+static int
+generate_one(const struct parser *parser,
+	     const char *suffix,
+	     int grad,
+	     FILE *file)
+{
+	const struct parser_dag *dag, **nodes;
+	struct range *range;
+	uint64_t i, k, m;
+
+	dag = parser_dag(parser);
+	if (!(nodes = malloc(parser_size(parser) * sizeof (nodes[0])))) {
+		TRACE("out of memory");
+		return -1;
+	}
+	if (!(m = parser_order(parser, nodes)) ||
+	    !(range = range_open(parser))) {
+		FREE(nodes);
+		TRACE(0);
+		return -1;
+	}
+	fprintf(file, "double evaluate%s(const double *vars) {\n", suffix);
+	fprintf(file, "(void)vars;\n");
+	for (i=0; i<m; ++i) {
+		reflect(nodes[i], range, file, 0);
+	}
+	fprintf(file, "return sigmoid_(t%d);\n}\n", dag->id);
+	if (grad) {
+		generate_grad(parser, range, nodes, m, suffix, file);
+	}
+	fprintf(file,
+		"void evaluate_batch%s(const double *const *cols,"
+		" double *__restrict__ out,"
+		" size_t n) {\n",
+		suffix);
+	fprintf(file, "size_t i, j, m;\n");
+	for (k=0; k<parser_symbol_size(parser); ++k) {
+		fprintf(file,
+			"const double *__restrict__ c%lu = cols[%lu];\n",
+			(unsigned long)k,
+			(unsigned long)k);
+	}
+	fprintf(file, "(void)cols;\n");
+	fprintf(file, "for (j=0; j<n; j+=%d) {\n", BATCH_BLOCK);
+	fprintf(file, "m = (n - j) < %d ? n : (j + %d);\n",
+		BATCH_BLOCK,
+		BATCH_BLOCK);
+	fprintf(file, "for (i=j; i<m; ++i) {\n");
+	for (i=0; i<m; ++i) {
+		reflect(nodes[i], range, file, 1);
+	}
+	fprintf(file, "out[i] = t%d;\n}\n", dag->id);
+	fprintf(file, "for (i=j; i<m; ++i) {\n");
+	fprintf(file, "out[i] = sigmoid_(out[i]);\n}\n");
+	fprintf(file, "}\n}\n");
+	range_close(range);
+	FREE(nodes);
+	return 0;
+}
+
+int
+generate(const struct parser *const *parsers, int n, int grad, FILE *file)
+{
+	char suffix[32];
+	int k;
+
+	fprintf(file, "#include <stddef.h>\n");
+	fprintf(file,
+		"static inline double sigmoid_(double x) {\n"
+		"return 1.0 / (1.0 + __builtin_exp(- x));\n"
+		"}\n"
+		"static inline double min_(double a, double b) {\n"
+		"return (a < b) ? a : b;\n"
+		"}\n"
+		"static inline double max_(double a, double b) {\n"
+		"return (a > b) ? a : b;\n"
+		"}\n");
+	/*
+	 * Branch-free b ? (a / b) : 0.0, for the batch loop's divisors not
+	 * proven non-zero (see range_open()). The divisor is nudged to 1.0
+	 * when zero and the quotient is masked off with integer ops; a ?:
+	 * select would keep gcc from if-converting the loop under
+	 * -ftrapping-math.
+	 */
+	fprintf(file,
+		"static inline double div_(double a, double b) {\n"
+		"double q = a / (b + (double)(b == 0.0));\n"
+		"unsigned long long m = -(unsigned long long)(b != 0.0), x;\n"
+		"__builtin_memcpy(&x, &q, sizeof (x));\n"
+		"x &= m;\n"
+		"__builtin_memcpy(&q, &x, sizeof (q));\n"
+		"return q;\n"
+		"}\n");
+	for (k=0; k<n; ++k) {
+		safe_sprintf(suffix, sizeof (suffix), (1 == n) ? "" : "_%d", k);
+		if (generate_one(parsers[k], suffix, grad, file)) {
+			TRACE(0);
+			return -1;
+		}
+	}
+	fprintf(file,
+		"typedef double (*evaluate_t)(const double *);\n"
+		"typedef void (*evaluate_batch_t)(const double *const *,"
+		" double *,"
+		" size_t);\n"
+		"typedef double (*evaluate_grad_t)(const double *, double *);\n");
+	fprintf(file, "const size_t dispatch_size = %d;\n", n);
+	fprintf(file, "const evaluate_t dispatch[] = {\n");
+	for (k=0; k<n; ++k) {
+		safe_sprintf(suffix, sizeof (suffix), (1 == n) ? "" : "_%d", k);
+		fprintf(file, "evaluate%s,\n", suffix);
+	}
+	fprintf(file, "};\n");
+	fprintf(file, "const evaluate_batch_t dispatch_batch[] = {\n");
+	for (k=0; k<n; ++k) {
+		safe_sprintf(suffix, sizeof (suffix), (1 == n) ? "" : "_%d", k);
+		fprintf(file, "evaluate_batch%s,\n", suffix);
+	}
+	fprintf(file, "};\n");
+	if (grad) {
+		fprintf(file, "const evaluate_grad_t dispatch_grad[] = {\n");
+		for (k=0; k<n; ++k) {
+			safe_sprintf(suffix,
+				     sizeof (suffix),
+				     (1 == n) ? "" : "_%d",
+				     k);
+			fprintf(file, "evaluate_grad%s,\n", suffix);
+		}
+		fprintf(file, "};\n");
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * generate.h
+ */
+
+#ifndef _GENERATE_H_
+#define _GENERATE_H_
+
+#include "parser.h"
+
+/* bump whenever generate() changes, it keys the module cache */
+#define GENERATOR_VERSION 8
+
+/**
+ * Writes the C source of one module for n expressions. A single
+ * expression is exported as evaluate() and evaluate_batch(), otherwise
+ * expression k as evaluate_<k>() and evaluate_batch_<k>(). The module
+ * also exports dispatch[] and dispatch_batch[], both indexed by k, and
+ * their length dispatch_size. The value of every expression is passed
+ * through sigmoid(), which is defined inline in the module, as are the
+ * calls of the expression language (see parser_open()).
+ *
+ * With grad set, the module also exports evaluate_grad() (likewise
+ * evaluate_grad_<k>() and dispatch_grad[]):
+ *
+ *   double evaluate_grad(const double *vars, double *grad)
+ *
+ * returns the value of evaluate(vars) and stores its partial derivative
+ * with respect to vars[k] in grad[k], for each of the
+ * parser_symbol_size() variables. It is compiled reverse-mode
+ * differentiation over the DAG: one forward and one backward pass,
+ * independent of the number of variables. It adds half to nearly all of
+ * gcc's time again, hence the flag.
+ *
+ * parsers: the parsed expressions
+ * n      : the number of expressions
+ * grad   : BOOL: also emit the gradients
+ * file   : the C source is written here
+ *
+ * return: 0 on success, otherwise error
+ */
+
+int generate(const struct parser *const *parsers,
+	     int n,
+	     int grad,
+	     FILE *file);
+
+#endif /* _GENERATE_H_ */
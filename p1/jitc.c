@@ -6,21 +6,35 @@
  * CS 238P - Operating Systems
  * jitc.c
  */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
 #include <dlfcn.h>
 #include "system.h"
 #include "jitc.h"
+#include "x64.h"
 
 /**
  * Needs:
+ *   pipe2()
+ *   memfd_create()
  *   fork()
  *   execv()
  *   waitpid()
+ *   kill()
  *   WIFEXITED()
  *   WEXITSTATUS()
  *   dlopen()
@@ -30,77 +44,349 @@
 
 /* research the above Needed API and design accordingly */
 
+/* flags shared by every module, also folded into the cache key */
+static const char *const compiler_flags[] = {
+    "-fpic",
+    "-fno-math-errno", /* inline sqrt, errno is never read */
+    "-pipe",         /* no temporary files between compiler passes */
+    "-shared"
+};
+
+static const char *const opt_levels[] = { "-O0", "-O1", "-O2", "-O3" };
+
+/* -O3 -march=native, which lets evaluate_batch use AVX2/AVX-512 */
+static const struct jitc_options default_options = {
+    3, 1, 0, NULL, NULL, JITC_PGO_NONE, NULL
+};
+
+/*
+ * Profile-guided builds name their data <pgo_dir>/jitc.gcda through
+ * -dumpdir/-dumpbase, whatever the output (e.g. a memfd) is called, so
+ * that the -fprofile-use build finds what the instrumented one wrote.
+ * __gcov_dump is forced into the instrumented module for
+ * jitc_profile_dump(). Functions that never ran, e.g. evaluate_batch
+ * when only evaluate was called, are still optimized normally.
+ */
+static const char *const pgo_generate_flags[] = {
+    "-fprofile-generate",
+    "-Wl,-u,__gcov_dump"
+};
+
+static const char *const pgo_use_flags[] = {
+    "-fprofile-use",
+    "-fprofile-partial-training",
+    "-Wno-missing-profile"
+};
+
+static size_t list_size(const char *const *list) {
+    size_t n = 0;
+
+    while (list && list[n]) {
+        ++n;
+    }
+    return n;
+}
 
-int jitc_compile(const char *input, const char *output) {
+/*
+ * Streams the C program into fd, which is closed. SIGPIPE is blocked in
+ * the calling thread meanwhile, so that a gcc that dies early shows up as
+ * EPIPE instead of killing the host, and any such signal is discarded.
+ */
+static int write_source(int fd, jitc_source_t source, void *arg) {
+    struct timespec zero = {0, 0};
+    sigset_t set, old;
+    FILE *file;
+    int rc;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    if (!(file = fdopen(fd, "w"))) {
+        perror("fdopen");
+        close(fd);
+        rc = -1;
+    } else {
+        rc = source(arg, file);
+        if (fclose(file)) {
+            rc = -1;
+        }
+    }
+    if (!sigismember(&old, SIGPIPE)) {
+        while (sigtimedwait(&set, NULL, &zero) > 0) {
+            /* discard */
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return rc;
+}
+
+/*
+ * Starts gcc on input, or with input NULL on the C program read from fd
+ * in ("-x c -"), with the given profile (NULL: default_options). keep (or
+ * -1) is made inheritable in the child only, e.g. a memfd named by output.
+ *
+ * return: the child's pid or -1 on error
+ */
+static pid_t spawn_gcc(const char *input,
+                       const char *output,
+                       const struct jitc_options *options,
+                       int in,
+                       int keep) {
     const char *gcc_path = "/usr/bin/gcc";
-    const char *shared_option = "-shared";
     const char *output_option = "-o";
-    const char *main_file = "main.o";
 
     char **compiler_args;
-    int num_args = 8;
-
+    char *dumpdir = NULL;
+    size_t num_args;
+    size_t i, k;
+    int opt;
     pid_t pid;
-    int status;
 
+    if (!options) {
+        options = &default_options;
+    }
+    num_args = ARRAY_SIZE(compiler_flags) + 19 +
+               list_size(options->flags) + list_size(options->inputs);
     compiler_args = (char **)malloc((num_args + 1) * sizeof(char *));
     if (compiler_args == NULL) {
         perror("malloc");
         return -1;
     }
+    if (options->pgo != JITC_PGO_NONE) {
+        if (!options->pgo_dir ||
+            !(dumpdir = malloc(strlen(options->pgo_dir) + 2))) {
+            TRACE("no profile directory");
+            free(compiler_args);
+            return -1;
+        }
+        safe_sprintf(dumpdir,
+                     strlen(options->pgo_dir) + 2,
+                     "%s/",
+                     options->pgo_dir);
+    }
 
-    compiler_args[0] = (char *)gcc_path;
-    compiler_args[1] = "-O3";
-    compiler_args[2] = "-fpic";
-    compiler_args[3] = (char *)shared_option;
-    compiler_args[4] = (char *)output_option;
-    compiler_args[5] = (char *)output;
-    compiler_args[6] = (char *)input;
-    compiler_args[7] = (char *)main_file;
-    compiler_args[8] = NULL;
+    k = 0;
+    compiler_args[k++] = (char *)gcc_path;
+    for (i = 0; i < ARRAY_SIZE(compiler_flags); ++i) {
+        compiler_args[k++] = (char *)compiler_flags[i];
+    }
+    opt = options->opt < 0 ? 0 : options->opt > 3 ? 3 : options->opt;
+    compiler_args[k++] = (char *)opt_levels[opt];
+    if (options->native) {
+        compiler_args[k++] = "-march=native";
+    }
+    if (options->fast_math) {
+        compiler_args[k++] = "-ffast-math";
+    }
+    if (options->pgo == JITC_PGO_GENERATE) {
+        for (i = 0; i < ARRAY_SIZE(pgo_generate_flags); ++i) {
+            compiler_args[k++] = (char *)pgo_generate_flags[i];
+        }
+    } else if (options->pgo == JITC_PGO_USE) {
+        for (i = 0; i < ARRAY_SIZE(pgo_use_flags); ++i) {
+            compiler_args[k++] = (char *)pgo_use_flags[i];
+        }
+    }
+    if (dumpdir) {
+        compiler_args[k++] = "-dumpdir";
+        compiler_args[k++] = dumpdir;
+        compiler_args[k++] = "-dumpbase";
+        compiler_args[k++] = "jitc";
+    }
+    for (i = 0; i < list_size(options->flags); ++i) {
+        compiler_args[k++] = (char *)options->flags[i];
+    }
+    compiler_args[k++] = (char *)output_option;
+    compiler_args[k++] = (char *)output;
+    if (input) {
+        compiler_args[k++] = (char *)input;
+    } else {
+        compiler_args[k++] = "-x";
+        compiler_args[k++] = "c";
+        compiler_args[k++] = "-";
+        compiler_args[k++] = "-x";
+        compiler_args[k++] = "none";
+    }
+    for (i = 0; i < list_size(options->inputs); ++i) {
+        compiler_args[k++] = (char *)options->inputs[i];
+    }
+    compiler_args[k++] = "-lm"; /* exp() and friends, wherever loaded */
+    compiler_args[k] = NULL;
 
     if ((pid = fork()) == 0) {
-        /* Child process */
-        printf("Executing compiler with arguments:\n");
-        
+        /* Child process, may be forked from a multi-threaded host: no stdio */
+        if (!input && dup2(in, STDIN_FILENO) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+        if (keep >= 0 && fcntl(keep, F_SETFD, 0)) {
+            _exit(EXIT_FAILURE);
+        }
         execv(compiler_args[0], compiler_args);
-        perror("execv");
-        exit(EXIT_FAILURE);
+        {
+            static const char message[] = "execv: cannot run gcc\n";
+
+            if (write(STDERR_FILENO, message, sizeof message - 1) < 0) {
+                /* nothing left to report to */
+            }
+        }
+        _exit(EXIT_FAILURE);
     } else if (pid < 0) {
         /* Fork failed */
         perror("fork");
-        free(compiler_args);
+    }
+    free(compiler_args);
+    free(dumpdir);
+    return pid;
+}
+
+/*
+ * Maps a wait status of gcc to 0 on success, otherwise -1.
+ */
+static int gcc_status(int status) {
+    if (WIFEXITED(status)) {
+        int exit_status = WEXITSTATUS(status);
+        if (exit_status != 0) {
+            TRACE("Compilation failed");
+            return -1;
+        }
+        return 0;
+    }
+    TRACE("Compilation did not complete");
+    return -1;
+}
+
+/*
+ * Runs gcc on input, or with input NULL on the C program that source
+ * writes into a pipe to gcc's stdin, and waits for it.
+ */
+static int run_gcc(const char *input,
+                   const char *output,
+                   const struct jitc_options *options,
+                   jitc_source_t source,
+                   void *arg,
+                   int keep) {
+    int pipe_fds[2] = {-1, -1};
+    int status, rc = 0;
+    pid_t pid;
+
+    if (!input && pipe2(pipe_fds, O_CLOEXEC)) {
+        perror("pipe2");
         return -1;
-    } else {
-        /* Parent process */
-        if (waitpid(pid, &status, 0) == -1) {
+    }
+    if ((pid = spawn_gcc(input, output, options, pipe_fds[0], keep)) < 0) {
+        if (!input) {
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+        }
+        return -1;
+    }
+
+    /* Parent process */
+    if (!input) {
+        close(pipe_fds[0]);
+        if (write_source(pipe_fds[1], source, arg)) {
+            TRACE("Writing the C program failed");
+            rc = -1;
+        }
+    }
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
             perror("waitpid");
-            free(compiler_args);
             return -1;
         }
-        if (WIFEXITED(status)) {
-            int exit_status = WEXITSTATUS(status);
-            if (exit_status != 0) {
-                TRACE("Compilation failed");
-                free(compiler_args);
-                return -1;
-            } else {
-                printf("Compilation succeeded. Output file: %s\n", output);
+    }
+    if (gcc_status(status)) {
+        rc = -1;
+    }
+    return rc;
+}
+
+int jitc_compile(const char *input,
+                 const char *output,
+                 const struct jitc_options *options) {
+    return run_gcc(input, output, options, NULL, NULL, -1);
+}
+
+int jitc_compile_many(struct jitc_job *jobs, int n, int k) {
+    pid_t *pids;
+    int next, running, failed, status, i;
+    pid_t pid;
+
+    if (n <= 0) {
+        return 0;
+    }
+    if (k <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        k = (cpus > 0) ? (int)cpus : 1;
+    }
+    if (!(pids = malloc(n * sizeof(pid_t)))) {
+        TRACE("Out of memory");
+        return -1;
+    }
+    for (i = 0; i < n; ++i) {
+        pids[i] = -1;
+        jobs[i].status = -1;
+    }
+
+    next = running = 0;
+    while (next < n || running) {
+        /* keep up to k compilers in flight */
+        while (next < n && running < k) {
+            if ((pids[next] = spawn_gcc(jobs[next].input,
+                                        jobs[next].output,
+                                        jobs[next].options,
+                                        -1,
+                                        -1)) >= 0) {
+                ++running;
+            } else if (running) {
+                break; /* e.g. out of processes, retry once one exits */
+            }
+            ++next;
+        }
+        if (!running) {
+            continue;
+        }
+
+        /* whichever finishes first */
+        if ((pid = waitpid(-1, &status, 0)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("waitpid");
+            /* don't leave compilers behind, their jobs count as failed */
+            for (i = 0; i < next; ++i) {
+                if (pids[i] >= 0) {
+                    kill(pids[i], SIGKILL);
+                    while (waitpid(pids[i], &status, 0) == -1 && errno == EINTR) {
+                        /* retry */
+                    }
+                    pids[i] = -1;
+                }
+            }
+            break;
+        }
+        for (i = 0; i < next; ++i) {
+            if (pids[i] == pid) {
+                pids[i] = -1;
+                jobs[i].status = gcc_status(status);
+                --running;
+                break;
             }
-        } else {
-            TRACE("Compilation did not complete");
-            free(compiler_args);
-            return -1;
         }
     }
+    free(pids);
 
-    free(compiler_args);
-    return 0;
+    failed = 0;
+    for (i = 0; i < n; ++i) {
+        failed += jobs[i].status ? 1 : 0;
+    }
+    return failed;
 }
 
-
 struct jitc {
     void *module;  /* Handle to the dynamically loaded module*/
+    void *code;    /* or, machine code mapped by jitc_emit() */
+    size_t size;
 };
 
 struct jitc *jitc_open(const char *pathname) {
@@ -109,6 +395,7 @@ struct jitc *jitc_open(const char *pathname) {
         TRACE("Out of memory");
         return NULL;
     }
+    memset(jitc, 0, sizeof(struct jitc));
 
     jitc->module = dlopen(pathname, RTLD_LAZY | RTLD_LOCAL);
     if (!jitc->module) {
@@ -125,20 +412,101 @@ struct jitc *jitc_open(const char *pathname) {
     return jitc;
 }
 
+struct jitc *jitc_compile_memory(jitc_source_t source,
+                                 void *arg,
+                                 const struct jitc_options *options) {
+    char path[64];
+    struct jitc *jitc;
+    int fd;
+
+    /* the module never touches the file system */
+    if ((fd = memfd_create("jitc", MFD_CLOEXEC)) < 0) {
+        perror("memfd_create");
+        return NULL;
+    }
+    safe_sprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    if (run_gcc(NULL, path, options, source, arg, fd)) {
+        close(fd);
+        TRACE(0);
+        return NULL;
+    }
+    jitc = jitc_open(path);
+    close(fd); /* the mapping keeps the module alive */
+    return jitc;
+}
+
+struct jitc *jitc_emit(const struct parser *parser, double (*final)(double)) {
+    struct jitc *jitc;
+    struct x64 *x64;
+
+    if (!(x64 = x64_open(parser, final))) {
+        TRACE(0);
+        return NULL;
+    }
+    if (!(jitc = malloc(sizeof(struct jitc)))) {
+        TRACE("Out of memory");
+        x64_close(x64);
+        return NULL;
+    }
+    memset(jitc, 0, sizeof(struct jitc));
+
+    /* never writable and executable at the same time */
+    jitc->size = x64_size(x64);
+    jitc->code = mmap(NULL,
+                      jitc->size,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1,
+                      0);
+    if (jitc->code == MAP_FAILED) {
+        perror("mmap");
+        x64_close(x64);
+        free(jitc);
+        return NULL;
+    }
+    memcpy(jitc->code, x64_code(x64), jitc->size);
+    x64_close(x64);
+    if (mprotect(jitc->code, jitc->size, PROT_READ | PROT_EXEC)) {
+        perror("mprotect");
+        jitc_close(jitc);
+        return NULL;
+    }
+    return jitc;
+}
+
 void jitc_close(struct jitc *jitc) {
     if (jitc) {
         if (jitc->module) {
             dlclose(jitc->module);
         }
+        if (jitc->code) {
+            munmap(jitc->code, jitc->size);
+        }
         free(jitc);
     }
 }
 
+int jitc_profile_dump(struct jitc *jitc) {
+    void (*dump)(void);
+
+    /* writes the counters and keeps counting, merged on the next dump */
+    if (!(dump = (void (*)(void))jitc_lookup(jitc, "__gcov_dump"))) {
+        TRACE("not an instrumented module");
+        return -1;
+    }
+    dump();
+    return 0;
+}
+
 long jitc_lookup(struct jitc *jitc, const char *symbol) {
 
      /* Look up the symbol within the loaded module */
     void *address;
 
+    if (jitc && jitc->code) {
+        /* emitted code has a single entry point */
+        return strcmp(symbol, "evaluate") ? 0 : (long)jitc->code;
+    }
     if (!jitc || !jitc->module) {
         return 0;
     }
@@ -148,3 +516,246 @@ long jitc_lookup(struct jitc *jitc, const char *symbol) {
     /* Return the memory address*/
     return (long)address;
 }
+
+/**
+ * Module cache. Modules are stored as <dir>/<key>.so where key mixes the
+ * caller's expression hash with the compiler flags and host name (the
+ * flags include -march=native). A hit refreshes the file's mtime, which
+ * therefore orders the entries for LRU eviction.
+ */
+
+#define CACHE_PATH_MAX 4096
+
+static struct {
+    char dir[CACHE_PATH_MAX];
+    uint64_t capacity;
+    uint64_t salt;
+    uint64_t hits;      /* atomic, modules may be built from several threads */
+    uint64_t misses;    /* atomic */
+    uint64_t evictions; /* atomic */
+} cache;
+
+struct cache_entry {
+    time_t mtime;
+    uint64_t size;
+    char name[64];
+};
+
+static int make_dirs(const char *dir) {
+    char path[CACHE_PATH_MAX];
+    char *s;
+
+    safe_sprintf(path, sizeof(path), "%s", dir);
+    for (s = path + 1; ; ++s) {
+        if (*s == '/' || *s == '\0') {
+            char c = *s;
+            *s = '\0';
+            if (mkdir(path, 0755) && errno != EEXIST) {
+                perror(path);
+                return -1;
+            }
+            if (!(*s = c)) {
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+static uint64_t hash_list(uint64_t h, const char *const *list) {
+    size_t i, n = list_size(list);
+
+    h = hash_update(h, &n, sizeof(n));
+    for (i = 0; i < n; ++i) {
+        h = hash_update(h, list[i], strlen(list[i]) + 1);
+    }
+    return h;
+}
+
+static void cache_path(uint64_t key,
+                       const struct jitc_options *options,
+                       char *path,
+                       size_t len) {
+    uint64_t h = cache.salt;
+
+    if (!options) {
+        options = &default_options;
+    }
+    h = hash_update(h, &options->opt, sizeof(options->opt));
+    h = hash_update(h, &options->native, sizeof(options->native));
+    h = hash_update(h, &options->fast_math, sizeof(options->fast_math));
+    h = hash_list(h, options->flags);
+    h = hash_list(h, options->inputs);
+    h = hash_update(h, &options->pgo, sizeof(options->pgo));
+    if (options->pgo_dir) {
+        h = hash_update(h, options->pgo_dir, strlen(options->pgo_dir));
+    }
+    key = hash_update(h, &key, sizeof(key));
+    safe_sprintf(path, len, "%s/%016lx.so", cache.dir, (unsigned long)key);
+}
+
+static int cache_entry_cmp(const void *a, const void *b) {
+    const struct cache_entry *x = (const struct cache_entry *)a;
+    const struct cache_entry *y = (const struct cache_entry *)b;
+
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+static void cache_evict(const char *keep) {
+    struct cache_entry *entries = NULL, *tmp;
+    size_t n = 0, cap = 0, len, i;
+    char path[CACHE_PATH_MAX];
+    struct dirent *dirent;
+    uint64_t total = 0;
+    struct stat st;
+    DIR *dir;
+
+    if (!cache.capacity || !(dir = opendir(cache.dir))) {
+        return;
+    }
+    while ((dirent = readdir(dir))) {
+        len = strlen(dirent->d_name);
+        if (len < 3 || len >= sizeof(entries->name) ||
+            strcmp(dirent->d_name + len - 3, ".so")) {
+            continue;
+        }
+        if (strlen(cache.dir) + len + 2 > sizeof(path)) {
+            continue;
+        }
+        safe_sprintf(path, sizeof(path), "%s/%s", cache.dir, dirent->d_name);
+        if (stat(path, &st)) {
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? 2 * cap : 64;
+            if (!(tmp = realloc(entries, cap * sizeof(entries[0])))) {
+                TRACE("out of memory");
+                break;
+            }
+            entries = tmp;
+        }
+        entries[n].mtime = st.st_mtime;
+        entries[n].size = (uint64_t)st.st_size;
+        memcpy(entries[n].name, dirent->d_name, len + 1);
+        total += entries[n++].size;
+    }
+    closedir(dir);
+
+    /* oldest first */
+    qsort(entries, n, sizeof(entries[0]), cache_entry_cmp);
+    for (i = 0; i < n && total > cache.capacity; ++i) {
+        safe_sprintf(path, sizeof(path), "%s/%s", cache.dir, entries[i].name);
+        if (!strcmp(path, keep)) {
+            continue;
+        }
+        if (!unlink(path)) {
+            total -= entries[i].size;
+            __atomic_add_fetch(&cache.evictions, 1, __ATOMIC_RELAXED);
+        }
+    }
+    free(entries);
+}
+
+int jitc_cache_init(const char *dir, uint64_t capacity) {
+    char host[256];
+    size_t i;
+
+    memset(&cache, 0, sizeof(cache));
+    if (!safe_strlen(dir)) {
+        return 0;
+    }
+    /* room for "/<16 hex digits>.so.XXXXXX" */
+    if (safe_strlen(dir) + 48 > sizeof(cache.dir)) {
+        TRACE("cache directory name too long");
+        return -1;
+    }
+    if (make_dirs(dir)) {
+        TRACE(0);
+        return -1;
+    }
+    safe_sprintf(cache.dir, sizeof(cache.dir), "%s", dir);
+    cache.capacity = capacity;
+
+    cache.salt = HASH_INIT;
+    for (i = 0; i < ARRAY_SIZE(compiler_flags); ++i) {
+        cache.salt = hash_update(cache.salt,
+                                 compiler_flags[i],
+                                 strlen(compiler_flags[i]) + 1);
+    }
+    memset(host, 0, sizeof(host));
+    if (!gethostname(host, sizeof(host) - 1)) {
+        cache.salt = hash_update(cache.salt, host, strlen(host));
+    }
+    return 0;
+}
+
+struct jitc *jitc_cache_open(uint64_t key, const struct jitc_options *options) {
+    char path[CACHE_PATH_MAX];
+    struct jitc *jitc;
+
+    if (!cache.dir[0]) {
+        return NULL;
+    }
+    cache_path(key, options, path, sizeof(path));
+    if (access(path, R_OK)) {
+        __atomic_add_fetch(&cache.misses, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    if (!(jitc = jitc_open(path))) {
+        /* truncated or foreign module, drop it and rebuild */
+        file_delete(path);
+        __atomic_add_fetch(&cache.misses, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    if (utime(path, NULL)) {
+        /* ignore, the entry just ages sooner */
+    }
+    __atomic_add_fetch(&cache.hits, 1, __ATOMIC_RELAXED);
+    return jitc;
+}
+
+struct jitc *jitc_cache_compile(jitc_source_t source,
+                                void *arg,
+                                uint64_t key,
+                                const struct jitc_options *options) {
+    char path[CACHE_PATH_MAX];
+    char temp[CACHE_PATH_MAX];
+    int fd;
+
+    if (!cache.dir[0]) {
+        return NULL;
+    }
+    cache_path(key, options, path, sizeof(path));
+
+    /* unique across processes and the threads of this one, gcc overwrites it */
+    safe_sprintf(temp, sizeof(temp), "%s.XXXXXX", path);
+    if ((fd = mkstemp(temp)) < 0) {
+        perror("mkstemp");
+        return NULL;
+    }
+    if (fchmod(fd, 0644)) {
+        /* ignore, the module is then private to this user */
+    }
+    close(fd);
+
+    /* publish atomically so concurrent readers never see a partial module */
+    if (run_gcc(NULL, temp, options, source, arg, -1) || rename(temp, path)) {
+        file_delete(temp);
+        TRACE(0);
+        return NULL;
+    }
+    cache_evict(path);
+    return jitc_open(path);
+}
+
+void jitc_cache_stats(uint64_t *hits, uint64_t *misses, uint64_t *evictions) {
+    if (hits) {
+        *hits = __atomic_load_n(&cache.hits, __ATOMIC_RELAXED);
+    }
+    if (misses) {
+        *misses = __atomic_load_n(&cache.misses, __ATOMIC_RELAXED);
+    }
+    if (evictions) {
+        *evictions = __atomic_load_n(&cache.evictions, __ATOMIC_RELAXED);
+    }
+}
@@ -10,18 +10,81 @@
 #ifndef _JITC_H_
 #define _JITC_H_
 
+#include "parser.h"
+
 struct jitc;
 
+/**
+ * A compiler profile. Every function below that takes one treats NULL as
+ * -O3 -march=native with nothing else, the profile for hot code. Modules
+ * are always built with -fpic -fno-math-errno -shared and link nothing
+ * but inputs and libm, generated modules are self-contained (see
+ * generate()).
+ */
+
+struct jitc_options {
+	int opt;                   /* -O<opt>, 0 to 3 */
+	int native;                /* BOOL: -march=native */
+	int fast_math;             /* BOOL: -ffast-math */
+	const char *const *flags;  /* more gcc flags, NULL-terminated, or NULL */
+	const char *const *inputs; /* objects/libraries to link, likewise */
+	enum jitc_pgo {
+		JITC_PGO_NONE,
+		JITC_PGO_GENERATE, /* instrument, see jitc_profile_dump() */
+		JITC_PGO_USE       /* optimize with the profile in pgo_dir */
+	} pgo;
+	const char *pgo_dir;       /* an existing directory, unless NONE */
+};
+
+/**
+ * Writes a C program to file.
+ *
+ * return: 0 on success, otherwise error
+ */
+
+typedef int (*jitc_source_t)(void *arg, FILE *file);
+
 /**
  * Compiles a C program into a dynamically loadable module.
  *
- * input : the file pathname of the C program
- * output: the file pathname of the dynamically loadable module
+ * input  : the file pathname of the C program
+ * output : the file pathname of the dynamically loadable module
+ * options: the compiler profile, or NULL
  *
  * return: 0 on success, otherwise error
  */
 
-int jitc_compile(const char *input, const char *output);
+int jitc_compile(const char *input,
+		 const char *output,
+		 const struct jitc_options *options);
+
+/**
+ * One unit of work for jitc_compile_many().
+ */
+
+struct jitc_job {
+	const char *input;  /* the file pathname of the C program */
+	const char *output; /* the file pathname of the module */
+	const struct jitc_options *options; /* or NULL */
+	int status;         /* set on return: 0 on success, otherwise error */
+};
+
+/**
+ * Compiles a batch of C programs as jitc_compile() does, keeping up to k
+ * gcc processes in flight and starting the next job as soon as any one of
+ * them exits.
+ *
+ * jobs: the jobs, each status is set on return
+ * n   : the number of jobs
+ * k   : the maximum number of concurrent compilers (<= 0: online CPUs)
+ *
+ * return: the number of failed jobs (0 on success), or -1 on error
+ *
+ * Note: children are reaped with waitpid(-1), so the calling process must
+ *       have no other children running meanwhile, e.g. tier_open() builds
+ */
+
+int jitc_compile_many(struct jitc_job *jobs, int n, int k);
 
 /**
  * Loads a dynamically loadable module into the calling process' memory for
@@ -34,8 +97,38 @@ int jitc_compile(const char *input, const char *output);
 
 struct jitc *jitc_open(const char *pathname);
 
+/**
+ * Compiles a C program and loads it without touching the file system: the
+ * program is streamed to gcc over a pipe and the module is written into a
+ * memfd, which is then loaded through /proc/self/fd. Safe to call from
+ * concurrent threads.
+ *
+ * source : writes the C program, called once, on the calling thread
+ * arg    : passed to source
+ * options: the compiler profile, or NULL
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct jitc *jitc_compile_memory(jitc_source_t source,
+				 void *arg,
+				 const struct jitc_options *options);
+
 /*struct jitc *jitc_open();*/
 
+/**
+ * Translates an expression straight into machine code in an executable
+ * mapping, without gcc, temporary files or the dynamic loader. The only
+ * symbol of the returned handle is "evaluate" (see x64_open()).
+ *
+ * parser: the parsed expression
+ * final : applied to the value of the expression before it is returned
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct jitc *jitc_emit(const struct parser *parser, double (*final)(double));
+
 /**
  * Unloads a previously loaded dynamically loadable module.
  *
@@ -46,6 +139,16 @@ struct jitc *jitc_open(const char *pathname);
 
 void jitc_close(struct jitc *jitc);
 
+/**
+ * Writes the execution counts of a module built with JITC_PGO_GENERATE
+ * into its pgo_dir, for a later JITC_PGO_USE build of the same source
+ * and pgo_dir. Not to be called while the module runs on another thread.
+ *
+ * return: 0 on success, otherwise error
+ */
+
+int jitc_profile_dump(struct jitc *jitc);
+
 /**
  * Searches for a symbol in the dynamically loaded module associated with jitc.
  *
@@ -56,4 +159,55 @@ void jitc_close(struct jitc *jitc);
 
 long jitc_lookup(struct jitc *jitc, const char *symbol);
 
+/**
+ * Enables the persistent cache of compiled modules. Until this is called,
+ * or if dir is empty, the cache functions below miss.
+ *
+ * dir     : the cache directory, created if it does not exist
+ * capacity: upper bound in bytes on the total size of cached modules,
+ *           least recently used modules are evicted first (0: unbounded)
+ *
+ * return: 0 on success, otherwise error
+ */
+
+int jitc_cache_init(const char *dir, uint64_t capacity);
+
+/**
+ * Loads the module previously cached under key. The key identifies the
+ * module's source, e.g. parser_hash(); the compiler profile is folded in
+ * internally. Link inputs are keyed by name, not content.
+ *
+ * key    : the source key
+ * options: the compiler profile it was compiled with, or NULL
+ *
+ * return: an opaque handle or NULL on a cache miss
+ */
+
+struct jitc *jitc_cache_open(uint64_t key, const struct jitc_options *options);
+
+/**
+ * Compiles a C program into the cache under key and loads it. The program
+ * is streamed to gcc as in jitc_compile_memory().
+ *
+ * source : writes the C program
+ * arg    : passed to source
+ * key    : the source key (see jitc_cache_open())
+ * options: the compiler profile, or NULL
+ *
+ * return: an opaque handle or NULL on error or if the cache is disabled
+ */
+
+struct jitc *jitc_cache_compile(jitc_source_t source,
+				void *arg,
+				uint64_t key,
+				const struct jitc_options *options);
+
+/**
+ * Reports the cache counters accumulated by this process.
+ *
+ * Note: any of hits, misses, evictions may be NULL
+ */
+
+void jitc_cache_stats(uint64_t *hits, uint64_t *misses, uint64_t *evictions);
+
 #endif /* _JITC_H_ */
@@ -7,37 +7,50 @@
  * lexer.c
  */
 
+#include "arena.h"
 #include "lexer.h"
 
+/**
+ * The lexer, its tokens and names live in one arena. Every token consumes
+ * at least one character, so the token array is sized once from the input
+ * length and never moves; pages past the last token are never touched.
+ */
+
 struct lexer {
 	uint64_t size;
 	struct lexer_token *tokens;
+	struct arena *arena;
+	int own; /* the arena is private */
 };
 
 static struct lexer_token *
 mktoken(struct lexer *lexer, enum lexer_token_op op)
 {
-	struct lexer_token *token, *tokens;
-	size_t n;
+	struct lexer_token *token;
 
-	if (0 == (lexer->size % 100)) {
-		n = (lexer->size + 100) * sizeof (tokens[0]);
-		if (!(tokens = realloc(lexer->tokens, n))) {
-			TRACE("out of memory");
-			return NULL;
-		}
-		lexer->tokens = tokens;
-	}
 	token = &lexer->tokens[lexer->size++];
 	memset(token, 0, sizeof (struct lexer_token));
 	token->op = op;
 	return token;
 }
 
+static int
+mkname(struct lexer *lexer,
+       struct lexer_token *token,
+       const char *s,
+       size_t n)
+{
+	if (!(token->name = arena_strndup(lexer->arena, s, n))) {
+		TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
 static int
 tokenize(struct lexer *lexer, const char *s)
 {
-	const char * const OPERATORS = "+-*/()";
+	const char * const OPERATORS = "+-*/(),";
 	struct lexer_token *token;
 	size_t i;
 	char *e;
@@ -59,6 +72,15 @@ tokenize(struct lexer *lexer, const char *s)
 		else if (isspace(*s)) {
 			++s;
 		}
+		else if (isalpha(*s) || ('_' == (*s))) {
+			for (i=1; isalnum(s[i]) || ('_' == s[i]); ++i);
+			if (!(token = mktoken(lexer, LEXER_OP_VAR)) ||
+			    mkname(lexer, token, s, i)) {
+				TRACE(0);
+				return -1;
+			}
+			s += i;
+		}
 		else {
 			if (!(token = mktoken(lexer, LEXER_OP_VAL))) {
 				TRACE(0);
@@ -76,18 +98,35 @@ tokenize(struct lexer *lexer, const char *s)
 }
 
 struct lexer *
-lexer_open(const char *s)
+lexer_open(const char *s, struct arena *arena)
 {
 	struct lexer *lexer;
+	int own;
 
 	assert( safe_strlen(s) );
 
-	if (!(lexer = malloc(sizeof (struct lexer)))) {
-		TRACE("out of memory");
+	own = 0;
+	if (!arena) {
+		if (!(arena = arena_open())) {
+			TRACE(0);
+			return NULL;
+		}
+		own = 1;
+	}
+	if (!(lexer = arena_malloc(arena, sizeof (struct lexer)))) {
+		if (own) {
+			arena_close(arena);
+		}
+		TRACE(0);
 		return NULL;
 	}
 	memset(lexer, 0, sizeof (struct lexer));
-	if (tokenize(lexer, s)) {
+	lexer->arena = arena;
+	lexer->own = own;
+	if (!(lexer->tokens = arena_malloc(arena,
+					   safe_strlen(s) *
+					   sizeof (lexer->tokens[0]))) ||
+	    tokenize(lexer, s)) {
 		lexer_close(lexer);
 		TRACE(0);
 		return NULL;
@@ -98,11 +137,9 @@ lexer_open(const char *s)
 void
 lexer_close(struct lexer *lexer)
 {
-	if (lexer) {
-		FREE(lexer->tokens);
-		memset(lexer, 0, sizeof (struct lexer));
+	if (lexer && lexer->own) {
+		arena_close(lexer->arena);
 	}
-	FREE(lexer);
 }
 
 uint64_t
@@ -16,19 +16,33 @@ struct lexer_token {
 	enum lexer_token_op {
 		LEXER_OP_,
 		LEXER_OP_VAL,
+		LEXER_OP_VAR,
 		LEXER_OP_ADD,  /* '+' */
 		LEXER_OP_SUB,  /* '-' */
 		LEXER_OP_MUL,  /* '*' */
 		LEXER_OP_DIV,  /* '/' */
 		LEXER_OP_OPEN, /* '(' */
-		LEXER_OP_CLOSE /* ')' */
+		LEXER_OP_CLOSE, /* ')' */
+		LEXER_OP_COMMA  /* ',' */
 	} op;
 	double val;
+	const char *name; /* LEXER_OP_VAR, also a function name before '(' */
 };
 
 struct lexer;
+struct arena;
 
-struct lexer *lexer_open(const char *s);
+/**
+ * Splits s into tokens.
+ *
+ * s    : the expression
+ * arena: tokens and names are allocated here, it must outlive the
+ *        handle; or NULL for a private arena released by lexer_close()
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct lexer *lexer_open(const char *s, struct arena *arena);
 
 void lexer_close(struct lexer *lexer);
 
@@ -8,138 +8,1054 @@
  */
 
 #include "jitc.h"
+#include "generate.h"
+#include "tier.h"
+#include "range.h"
+#include "vm.h"
+#include "x64.h"
 #include "parser.h"
 #include "system.h"
 #include <math.h>
 
 /* export LD_LIBRARY_PATH=. */
 
+#define CACHE_CAPACITY (64UL * 1024 * 1024)
+
+/**
+ * Cost model for picking the VM or gcc, in nanoseconds per bytecode
+ * instruction (see vm_size()), fit to the vm_saving and jitc_compile
+ * phases of "make bench" (one CPU, -O3 -march=native): over 8 to 512
+ * leaves native code saves 1.5-3 ns per VM instruction, and gcc takes
+ * 70-110 ms at 10 instructions and 0.45-1.3 s at 500, about 90 ms plus
+ * 0.7 (chain) to 2.4 (nested) ms per instruction, 1.5 ms for balanced
+ * shapes. The JIT therefore pays off only past 750k rows plus 45M /
+ * insns, e.g. 3M rows at 20 instructions and 1.4M rows at 67.
+ */
+
+#define VM_SAVING_NS 2
+#define JIT_BASE_NS 90000000UL
+#define JIT_INSN_NS 1500000UL
+
+/* tiered calls after which a module is rebuilt from its profile (-t) */
+
+#define PGO_CALLS 10000
+
+double sigmoid(double x) {
+    return 1.0 / (1.0 + exp(-x));
+}
+
+typedef double (*evaluate_t)(const double *vars);
+
+typedef void (*evaluate_batch_t)(const double *const *cols,
+				 double *out,
+				 size_t n);
+
+typedef double (*evaluate_grad_t)(const double *vars, double *grad);
+
+/**
+ * Input rows in columnar form, bound from name=v0,v1,... arguments. Every
+ * name must be bound at most once and all columns must have the same
+ * number of rows.
+ */
+
+struct bindings {
+	uint64_t rows;
+	uint64_t size;
+	const char **names; /* point into argv */
+	double **cols;
+};
+
+/**
+ * One expression's view of the bindings, cols[var][row] in the order of
+ * the expression's symbol table. The columns belong to the bindings.
+ */
+
+struct table {
+	uint64_t rows;
+	uint64_t size;
+	double **cols;
+};
+
 static void
-reflect(const struct parser_dag *dag, FILE *file)
-{
-	if (dag) {
-		reflect(dag->left, file);
-		reflect(dag->right, file);
-		if (PARSER_DAG_VAL == dag->op) {
-			fprintf(file,
-				"double t%d = %f;\n",
-				dag->id,
-				dag->val);
-		}
-		else if (PARSER_DAG_NEG == dag->op) {
-			fprintf(file,
-				"double t%d = - t%d;\n",
-				dag->id,
-				dag->right->id);
-		}
-		else if (PARSER_DAG_MUL == dag->op) {
-			fprintf(file,
-				"double t%d = t%d * t%d;\n",
-				dag->id,
-				dag->left->id,
-				dag->right->id);
-		}
-		else if (PARSER_DAG_DIV == dag->op) {
-			fprintf(file,
-				"double t%d = t%d ? (t%d / t%d) : 0.0;\n",
-				dag->id,
-				dag->right->id,
-				dag->left->id,
-				dag->right->id);
-		}
-		else if (PARSER_DAG_ADD == dag->op) {
-			fprintf(file,
-				"double t%d = t%d + t%d;\n",
-				dag->id,
-				dag->left->id,
-				dag->right->id);
-		}
-		else if (PARSER_DAG_SUB == dag->op) {
-			fprintf(file,
-				"double t%d = t%d - t%d;\n",
-				dag->id,
-				dag->left->id,
-				dag->right->id);
+bindings_close(struct bindings *bindings)
+{
+	uint64_t i;
+
+	if (bindings) {
+		for (i=0; i<bindings->size; ++i) {
+			FREE(bindings->cols[i]);
 		}
-		else {
-			EXIT("software");
+		FREE(bindings->names);
+		FREE(bindings->cols);
+		memset(bindings, 0, sizeof (struct bindings));
+	}
+	FREE(bindings);
+}
+
+static double *
+column(char *s, uint64_t *rows)
+{
+	double *col;
+	uint64_t i;
+	char *e;
+
+	(*rows) = 1;
+	for (e=s; (*e); ++e) {
+		if (',' == (*e)) {
+			++(*rows);
+		}
+	}
+	if (!(col = malloc((*rows) * sizeof (col[0])))) {
+		TRACE("out of memory");
+		return NULL;
+	}
+	for (i=0; i<(*rows); ++i) {
+		col[i] = strtod(s, &e);
+		if ((s == e) || ((*e) && (',' != (*e)))) {
+			FREE(col);
+			return NULL;
 		}
+		s = e + 1;
 	}
+	return col;
 }
 
-double sigmoid(double x) {
-    return 1.0 / (1.0 + exp(-x));
+static int
+bindings_find(const struct bindings *bindings, const char *name)
+{
+	uint64_t i;
+
+	for (i=0; i<bindings->size; ++i) {
+		if (!strcmp(bindings->names[i], name)) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+static struct bindings *
+bindings_open(int argc, char *argv[])
+{
+	struct bindings *bindings;
+	uint64_t rows;
+	char *s;
+
+	if (!(bindings = malloc(sizeof (struct bindings)))) {
+		TRACE("out of memory");
+		return NULL;
+	}
+	memset(bindings, 0, sizeof (struct bindings));
+	if (!(bindings->names = malloc((argc + 1) * sizeof (char *))) ||
+	    !(bindings->cols = malloc((argc + 1) * sizeof (double *)))) {
+		bindings_close(bindings);
+		TRACE("out of memory");
+		return NULL;
+	}
+	for (; 0 < argc; --argc, ++argv) {
+		if (!(s = strchr(argv[0], '='))) {
+			fprintf(stderr, "expecting name=value: %s\n", argv[0]);
+			break;
+		}
+		*s++ = '\0';
+		if (0 <= bindings_find(bindings, argv[0])) {
+			fprintf(stderr, "variable bound twice: %s\n", argv[0]);
+			break;
+		}
+		if (!(bindings->cols[bindings->size] = column(s, &rows))) {
+			fprintf(stderr, "invalid value: %s=%s\n", argv[0], s);
+			break;
+		}
+		bindings->names[bindings->size++] = argv[0];
+		if (bindings->rows && (rows != bindings->rows)) {
+			fprintf(stderr, "column length mismatch: %s\n", argv[0]);
+			break;
+		}
+		bindings->rows = rows;
+	}
+	if (argc) {
+		bindings_close(bindings);
+		return NULL;
+	}
+	if (!bindings->rows) {
+		bindings->rows = 1;
+	}
+	return bindings;
 }
 
 static void
-generate(const struct parser_dag *dag, FILE *file)
+table_close(struct table *table)
 {
-	fprintf(file, "double sigmoid(double x);\n");
-	fprintf(file, "double evaluate(void) {\n");
-	reflect(dag, file);
-	fprintf(file, "return sigmoid(t%d);\n}\n", dag->id);
-	
+	if (table) {
+		FREE(table->cols);
+		memset(table, 0, sizeof (struct table));
+	}
+	FREE(table);
 }
 
-typedef double (*evaluate_t)(void);
+static struct table *
+table_open(const struct parser *parser, const struct bindings *bindings)
+{
+	struct table *table;
+	uint64_t i;
+	int j;
 
-int
-main(int argc, char *argv[])
+	if (!(table = malloc(sizeof (struct table)))) {
+		TRACE("out of memory");
+		return NULL;
+	}
+	memset(table, 0, sizeof (struct table));
+	table->rows = bindings->rows;
+	table->size = parser_symbol_size(parser);
+	if (!(table->cols = malloc((table->size + 1) * sizeof (double *)))) {
+		table_close(table);
+		TRACE("out of memory");
+		return NULL;
+	}
+	for (i=0; i<table->size; ++i) {
+		if (0 > (j = bindings_find(bindings,
+					   parser_symbol_lookup(parser, i)))) {
+			fprintf(stderr,
+				"unbound variable: %s\n",
+				parser_symbol_lookup(parser, i));
+			table_close(table);
+			return NULL;
+		}
+		table->cols[i] = bindings->cols[j];
+	}
+	return table;
+}
+
+/**
+ * Evaluates every row of table with fnc, or with batch in one call when
+ * there are multiple rows and the module has a batch kernel.
+ */
+
+static int
+evaluate_table(evaluate_t fnc,
+	       evaluate_batch_t batch,
+	       const struct table *table,
+	       double *out)
+{
+	double *vars;
+	uint64_t i, j;
+
+	if ((1 < table->rows) && batch) {
+		batch((const double *const *)table->cols,
+		      out,
+		      (size_t)table->rows);
+		return 0;
+	}
+	if (!(vars = malloc((table->size + 1) * sizeof (vars[0])))) {
+		TRACE("out of memory");
+		return -1;
+	}
+	for (i=0; i<table->rows; ++i) {
+		for (j=0; j<table->size; ++j) {
+			vars[j] = table->cols[j][i];
+		}
+		out[i] = fnc(vars);
+	}
+	FREE(vars);
+	return 0;
+}
+
+/**
+ * Finds the entry points of expression k in jitc, through the dispatch
+ * tables of a generated module or, for emitted code, by name.
+ */
+
+static int
+dispatch(struct jitc *jitc, int k, evaluate_t *fnc, evaluate_batch_t *batch)
 {
-	const char *SOFILE = "/home/nivedita/projects/p1/out.so";
-	const char *CFILE = "out.c";
-	struct parser *parser;
+	const evaluate_batch_t *batches;
+	const evaluate_t *fncs;
+	const size_t *size;
+
+	if ((size = (const size_t *)jitc_lookup(jitc, "dispatch_size")) &&
+	    (fncs = (const evaluate_t *)jitc_lookup(jitc, "dispatch")) &&
+	    (batches = (const evaluate_batch_t *)jitc_lookup(jitc,
+							     "dispatch_batch"))) {
+		if ((size_t)k >= (*size)) {
+			TRACE("software");
+			return -1;
+		}
+		(*fnc) = fncs[k];
+		(*batch) = batches[k];
+		return 0;
+	}
+	(*batch) = NULL;
+	if (k || !((*fnc) = (evaluate_t)jitc_lookup(jitc, "evaluate"))) {
+		TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+struct source {
+	const struct parser *const *parsers;
+	int n;
+	int grad;
+};
+
+static int
+source(void *arg, FILE *file)
+{
+	const struct source *source = (const struct source *)arg;
+
+	return generate(source->parsers, source->n, source->grad, file);
+}
+
+/**
+ * Returns one module for n expressions, generated and compiled by gcc in
+ * one go (see generate()). The module comes straight from the module
+ * cache when the same list of expressions was compiled before. The C
+ * source is piped to gcc and, with the cache disabled, the module stays
+ * in memory, so concurrent builds share no files. Profile-guided builds
+ * bypass the cache, their profiles are private to the process.
+ *
+ * grad   : BOOL: the module also exports the gradients
+ * options: the compiler profile, NULL for -O3 -march=native
+ */
+
+static struct jitc *
+build_many(const struct parser *const *parsers,
+	   int n,
+	   int grad,
+	   const struct jitc_options *options)
+{
+	const int version = GENERATOR_VERSION;
+	struct source arg;
 	struct jitc *jitc;
-	evaluate_t fnc;
-	FILE *file;
+	uint64_t key, h;
+	int k;
 
-	/* usage */
+	key = hash_update(HASH_INIT, &version, sizeof (version));
+	key = hash_update(key, &grad, sizeof (grad));
+	for (k=0; k<n; ++k) {
+		h = parser_hash(parsers[k]);
+		key = hash_update(key, &h, sizeof (h));
+	}
+	arg.parsers = parsers;
+	arg.n = n;
+	arg.grad = grad;
+	if (options && (JITC_PGO_NONE != options->pgo)) {
+		return jitc_compile_memory(source, &arg, options);
+	}
+	if ((jitc = jitc_cache_open(key, options))) {
+		return jitc;
+	}
+	if (!(jitc = jitc_cache_compile(source, &arg, key, options)) &&
+	    !(jitc = jitc_compile_memory(source, &arg, options))) {
+		TRACE(0);
+		return NULL;
+	}
+	return jitc;
+}
+
+/**
+ * Returns the module for parser's expression. With emit set, machine code
+ * is emitted in-process, otherwise see build_many().
+ */
+
+static struct jitc *
+build(const struct parser *parser, int emit)
+{
+	if (emit) {
+		return jitc_emit(parser, sigmoid);
+	}
+	return build_many(&parser, 1, 0, NULL);
+}
+
+static struct jitc *
+build_native(const struct parser *parser, const struct jitc_options *options)
+{
+	return build_many(&parser, 1, 0, options);
+}
+
+/**
+ * True if compiling with gcc is expected to be cheaper overall than
+ * interpreting rows evaluations of size instructions in total.
+ */
+
+static int
+worth_compiling(uint64_t size, uint64_t rows)
+{
+	return (rows * size * VM_SAVING_NS) > (JIT_BASE_NS + size * JIT_INSN_NS);
+}
 
-	if (2 != argc) {
-		printf("usage: %s expression\n", argv[0]);
+/**
+ * Evaluates every row of table with the bytecode VM in vm.
+ */
+
+static int
+evaluate_vm(struct vm *vm, const struct table *table, double *out)
+{
+	double *vars;
+	uint64_t i, j;
+
+	if (!(vars = malloc((table->size + 1) * sizeof (vars[0])))) {
+		TRACE("out of memory");
+		return -1;
+	}
+	for (i=0; i<table->rows; ++i) {
+		for (j=0; j<table->size; ++j) {
+			vars[j] = table->cols[j][i];
+		}
+		out[i] = vm_evaluate(vm, vars);
+	}
+	FREE(vars);
+	return 0;
+}
+
+/**
+ * Evaluates table row by row through a tier: the first rows are answered
+ * by the interpreter and printed at once, while gcc runs in the
+ * background; later rows run natively once the module is swapped in, and
+ * after PGO_CALLS of them, on the module rebuilt from their profile.
+ */
+
+static int
+evaluate_tiered(const struct parser *parser,
+		const struct table *table,
+		int verbose)
+{
+	uint64_t i, j, native, optimized;
+	struct tier *tier;
+	double *vars;
+
+	if (!(vars = malloc((table->size + 1) * sizeof (vars[0])))) {
+		TRACE("out of memory");
+		return -1;
+	}
+	if (!(tier = tier_open(parser, build_native, sigmoid, PGO_CALLS))) {
+		FREE(vars);
+		TRACE(0);
 		return -1;
 	}
+	for (i=0, native=0, optimized=0; i<table->rows; ++i) {
+		for (j=0; j<table->size; ++j) {
+			vars[j] = table->cols[j][i];
+		}
+		native += tier_native(tier) ? 1 : 0;
+		optimized += tier_optimized(tier) ? 1 : 0;
+		printf("%f\n", tier_evaluate(tier, vars));
+		fflush(stdout);
+	}
+	tier_close(tier);
+	FREE(vars);
+	if (verbose) {
+		fprintf(stderr,
+			"tier: %lu interpreted, %lu native"
+			" (%lu profile-guided)\n",
+			(unsigned long)(table->rows - native),
+			(unsigned long)native,
+			(unsigned long)optimized);
+	}
+	return 0;
+}
+
+/**
+ * Prints every row of table as the value of the expression followed by
+ * its partial derivatives, one per variable in symbol table order, all
+ * from one call of the module's evaluate_grad() (see generate()).
+ */
+
+static int
+evaluate_gradient(const struct parser *parser,
+		  const struct table *table,
+		  const struct jitc_options *options)
+{
+	evaluate_grad_t fnc;
+	struct jitc *jitc;
+	double *vars, *grad, y;
+	uint64_t i, j;
+
+	if (!(vars = malloc((table->size + 1) * sizeof (vars[0]))) ||
+	    !(grad = malloc((table->size + 1) * sizeof (grad[0])))) {
+		FREE(vars);
+		TRACE("out of memory");
+		return -1;
+	}
+	if (!(jitc = build_many(&parser, 1, 1, options)) ||
+	    !(fnc = (evaluate_grad_t)jitc_lookup(jitc, "evaluate_grad"))) {
+		jitc_close(jitc);
+		FREE(vars);
+		FREE(grad);
+		TRACE(0);
+		return -1;
+	}
+	for (i=0; i<table->rows; ++i) {
+		for (j=0; j<table->size; ++j) {
+			vars[j] = table->cols[j][i];
+		}
+		y = fnc(vars, grad);
+		printf("%f", y);
+		for (j=0; j<table->size; ++j) {
+			printf(" %f", grad[j]);
+		}
+		printf("\n");
+	}
+	jitc_close(jitc);
+	FREE(vars);
+	FREE(grad);
+	return 0;
+}
 
-	/* parse */
+/**
+ * What evaluate_gradient() prints for an expression that folded to a
+ * constant, y on every row: no code, every partial is zero.
+ */
 
-	if (!(parser = parser_open(argv[1]))) {
+static void
+constant_gradient(const struct table *table, double y)
+{
+	uint64_t i, j;
+
+	for (i=0; i<table->rows; ++i) {
+		printf("%f", y);
+		for (j=0; j<table->size; ++j) {
+			printf(" %f", 0.0);
+		}
+		printf("\n");
+	}
+}
+
+/**
+ * Everything the driver holds for n expressions over one set of bindings.
+ * out[k * rows + i] is the value of expression k on row i.
+ */
+
+struct session {
+	int n;
+	uint64_t rows;
+	struct bindings *bindings;
+	struct parser **parsers;
+	struct table **tables;
+	struct vm **vms;
+	struct jitc **jitcs;
+	double *out;
+};
+
+static void
+session_close(struct session *session)
+{
+	int k;
+
+	if (session) {
+		for (k=0; k<session->n; ++k) {
+			if (session->parsers) {
+				parser_close(session->parsers[k]);
+			}
+			if (session->tables) {
+				table_close(session->tables[k]);
+			}
+			if (session->vms) {
+				vm_close(session->vms[k]);
+			}
+			if (session->jitcs) {
+				jitc_close(session->jitcs[k]);
+			}
+		}
+		bindings_close(session->bindings);
+		FREE(session->parsers);
+		FREE(session->tables);
+		FREE(session->vms);
+		FREE(session->jitcs);
+		FREE(session->out);
+		memset(session, 0, sizeof (struct session));
+	}
+	FREE(session);
+}
+
+/**
+ * Parses the expressions in exprs[0..n-1], or loads those given as @file
+ * (see parser_save()), and binds the name=value arguments in
+ * argv[0..argc-1] to them. Every bound name must be used by
+ * at least one expression.
+ */
+
+static struct session *
+session_open(int n,
+	     char *exprs[],
+	     int argc,
+	     char *argv[],
+	     int fast_math)
+{
+	struct session *session;
+	uint64_t i;
+	int k;
+
+	if (!(session = calloc(1, sizeof (struct session)))) {
+		TRACE("out of memory");
+		return NULL;
+	}
+	session->n = n;
+	if (!(session->parsers = calloc(n, sizeof (struct parser *))) ||
+	    !(session->tables = calloc(n, sizeof (struct table *))) ||
+	    !(session->vms = calloc(n, sizeof (struct vm *))) ||
+	    !(session->jitcs = calloc(n, sizeof (struct jitc *)))) {
+		session_close(session);
+		TRACE("out of memory");
+		return NULL;
+	}
+	if (!(session->bindings = bindings_open(argc, argv))) {
+		session_close(session);
+		TRACE(0);
+		return NULL;
+	}
+	session->rows = session->bindings->rows;
+	for (k=0; k<n; ++k) {
+		if (!(session->parsers[k] = ('@' == exprs[k][0]) ?
+		      parser_load(exprs[k] + 1) :
+		      parser_open(exprs[k])) ||
+		    parser_optimize(session->parsers[k], fast_math) ||
+		    !(session->tables[k] = table_open(session->parsers[k],
+						      session->bindings))) {
+			session_close(session);
+			TRACE(0);
+			return NULL;
+		}
+	}
+	for (i=0; i<session->bindings->size; ++i) {
+		for (k=0; k<n; ++k) {
+			if (0 <= parser_symbol_find(session->parsers[k],
+						    session->bindings->names[i])) {
+				break;
+			}
+		}
+		if (k == n) {
+			fprintf(stderr,
+				"unknown variable: %s\n",
+				session->bindings->names[i]);
+			session_close(session);
+			return NULL;
+		}
+	}
+	if (!(session->out = malloc(n * session->rows * sizeof (double)))) {
+		session_close(session);
+		TRACE("out of memory");
+		return NULL;
+	}
+	return session;
+}
+
+static int
+constant(const struct parser *parser)
+{
+	return PARSER_DAG_VAL == parser_dag(parser)->op;
+}
+
+/**
+ * Interprets every non-constant expression with the VM when forced to,
+ * or when gcc is not expected to pay off for the combined size of the
+ * expressions, which share one compile.
+ *
+ * return: 1 if evaluated, 0 if the expressions should be compiled,
+ *         negative on error
+ */
+
+static int
+evaluate_interpreted(struct session *session, int interpret, int verbose)
+{
+	uint64_t size;
+	int k;
+
+	for (k=0, size=0; k<session->n; ++k) {
+		if (!constant(session->parsers[k])) {
+			if (!(session->vms[k] = vm_open(session->parsers[k],
+							sigmoid))) {
+				TRACE(0);
+				return -1;
+			}
+			size += vm_size(session->vms[k]);
+		}
+	}
+	if (!interpret && worth_compiling(size, session->rows)) {
+		return 0;
+	}
+	for (k=0; k<session->n; ++k) {
+		if (session->vms[k] &&
+		    evaluate_vm(session->vms[k],
+				session->tables[k],
+				session->out + k * session->rows)) {
+			TRACE(0);
+			return -1;
+		}
+	}
+	if (verbose) {
+		fprintf(stderr,
+			"vm: %lu instruction(s), %lu row(s)\n",
+			(unsigned long)size,
+			(unsigned long)session->rows);
+	}
+	return 1;
+}
+
+/**
+ * Picks the gcc profile for the session: -O3 -march=native when compiling
+ * pays off (see worth_compiling()), otherwise, i.e. when forced with -j,
+ * the workload is too small to repay optimization and -O0, which compiles
+ * fastest, is used. The expressions' node count stands in for their
+ * instruction count.
+ */
+
+static void
+profile(const struct session *session,
+	int fast_math,
+	struct jitc_options *options)
+{
+	uint64_t size;
+	int k, hot;
+
+	for (k=0, size=0; k<session->n; ++k) {
+		if (!constant(session->parsers[k])) {
+			size += parser_size(session->parsers[k]);
+		}
+	}
+	hot = worth_compiling(size, session->rows);
+	memset(options, 0, sizeof (struct jitc_options));
+	options->opt = hot ? 3 : 0;
+	options->native = hot;
+	options->fast_math = fast_math;
+}
+
+/**
+ * True if every expression fits x64_open(), see X64_MAX_NODES.
+ */
+
+static int
+emittable(const struct session *session)
+{
+	int k;
+
+	for (k=0; k<session->n; ++k) {
+		if (X64_MAX_NODES < parser_size(session->parsers[k])) {
+			fprintf(stderr,
+				"x64: expression %d has more than %d nodes,"
+				" interpreted instead\n",
+				k + 1,
+				X64_MAX_NODES);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Compiles the non-constant expressions, each into its own emitted code
+ * with emit set, otherwise all of them into one module built with options,
+ * and evaluates.
+ */
+
+static int
+evaluate_compiled(struct session *session,
+		  int emit,
+		  const struct jitc_options *options)
+{
+	const struct parser **parsers;
+	evaluate_batch_t batch;
+	evaluate_t fnc;
+	struct jitc *jitc;
+	int k, m;
+
+	if (!(parsers = malloc(session->n * sizeof (parsers[0])))) {
+		TRACE("out of memory");
+		return -1;
+	}
+	for (k=0, m=0; k<session->n; ++k) {
+		if (!constant(session->parsers[k])) {
+			if (emit &&
+			    !(session->jitcs[k] = build(session->parsers[k], 1))) {
+				FREE(parsers);
+				TRACE(0);
+				return -1;
+			}
+			parsers[m++] = session->parsers[k];
+		}
+	}
+	if (!emit &&
+	    m &&
+	    !(session->jitcs[0] = build_many(parsers, m, 0, options))) {
+		FREE(parsers);
 		TRACE(0);
 		return -1;
 	}
+	FREE(parsers);
+	for (k=0, m=0; k<session->n; ++k) {
+		if (constant(session->parsers[k])) {
+			continue;
+		}
+		jitc = emit ? session->jitcs[k] : session->jitcs[0];
+		if (dispatch(jitc, emit ? 0 : m++, &fnc, &batch) ||
+		    evaluate_table(fnc,
+				   batch,
+				   session->tables[k],
+				   session->out + k * session->rows)) {
+			TRACE(0);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Prints how many division guards range analysis removed from each
+ * compiled expression (see range_open()).
+ */
+
+static void
+report_guards(const struct session *session)
+{
+	uint64_t divisions, proven;
+	struct range *range;
+	int k;
+
+	for (k=0; k<session->n; ++k) {
+		if (constant(session->parsers[k]) ||
+		    !(range = range_open(session->parsers[k]))) {
+			continue;
+		}
+		range_guards(range, session->parsers[k], &divisions, &proven);
+		range_close(range);
+		fprintf(stderr,
+			"range: expression %d, %lu of %lu division guard(s)"
+			" removed\n",
+			k + 1,
+			(unsigned long)proven,
+			(unsigned long)divisions);
+	}
+}
+
+/**
+ * Turns the module cache on in $JITC_CACHE if set, else with enable in
+ * $XDG_CACHE_HOME/cs238 or ~/.cache/cs238. Off by default: nothing is
+ * written outside the working directory unless asked for.
+ */
+
+static int
+cache_init(int enable)
+{
+	char dir[1024];
+	const char *s;
+
+	if ((s = getenv("JITC_CACHE")) && safe_strlen(s)) {
+		return jitc_cache_init(s, CACHE_CAPACITY);
+	}
+	if (!enable) {
+		return 0;
+	}
+	if ((s = getenv("XDG_CACHE_HOME")) &&
+	    ('/' == s[0]) &&
+	    (safe_strlen(s) + 8 < sizeof (dir))) {
+		safe_sprintf(dir, sizeof (dir), "%s/cs238", s);
+		return jitc_cache_init(dir, CACHE_CAPACITY);
+	}
+	if ((s = getenv("HOME")) && (safe_strlen(s) + 16 < sizeof (dir))) {
+		safe_sprintf(dir, sizeof (dir), "%s/.cache/cs238", s);
+		return jitc_cache_init(dir, CACHE_CAPACITY);
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t i, hits, misses, evictions;
+	struct jitc_options options;
+	struct session *session;
+	int verbose, emit, fast_math, tiered, interpret, compile, gradient;
+	int cache;
+	const char *save;
+	int k, n, r;
 
-	/* generate C */
+	/* usage */
 
-	if (!(file = fopen(CFILE, "w"))) {
-		TRACE("fopen()");
+	verbose = emit = fast_math = tiered = interpret = compile = 0;
+	gradient = cache = 0;
+	save = NULL;
+	for (; (1 < argc) && ('-' == argv[1][0]); --argc, ++argv) {
+		if (!strcmp(argv[1], "-v")) {
+			verbose = 1;
+		}
+		else if (!strcmp(argv[1], "-x")) {
+			emit = 1;
+		}
+		else if (!strcmp(argv[1], "-f")) {
+			fast_math = 1;
+		}
+		else if (!strcmp(argv[1], "-t")) {
+			tiered = 1;
+		}
+		else if (!strcmp(argv[1], "-i")) {
+			interpret = 1;
+		}
+		else if (!strcmp(argv[1], "-j")) {
+			compile = 1;
+		}
+		else if (!strcmp(argv[1], "-g")) {
+			gradient = 1;
+		}
+		else if (!strcmp(argv[1], "-c")) {
+			cache = 1;
+		}
+		else if (!strcmp(argv[1], "-o") && (2 < argc)) {
+			save = argv[2];
+			--argc;
+			++argv;
+		}
+		else if (!strcmp(argv[1], "--")) {
+			--argc;
+			++argv;
+			break;
+		}
+		else {
+			break;
+		}
+	}
+	for (n=0; (n + 1 < argc) && !strchr(argv[n + 1], '='); ++n) {
+		/* expressions come before the first name=value */
+	}
+	if (!n || ((tiered || gradient || save) && (1 < n))) {
+		printf("usage: %s [-v] [-x] [-f] [-t|-g] [-i|-j] [-c] [-o file]"
+		       " [--] expression..."
+		       " [name=value[,value...] ...]\n"
+		       "  -v  print module cache, VM and tier statistics\n"
+		       "  -x  emit machine code in-process instead of gcc\n"
+		       "  -f  allow optimizations that are not IEEE-754 exact\n"
+		       "  -t  interpret while gcc runs in the background"
+		       " (one expression)\n"
+		       "  -i  always interpret, never run gcc\n"
+		       "  -j  always compile, by default small workloads"
+		       " are interpreted\n"
+		       "multiple expressions are compiled into one module and"
+		       " print one column each\n",
+		       argv[0]);
+		printf("  -g  print each value's partial derivatives, one per"
+		       " variable (one expression, compiled)\n");
+		printf("  -c  keep compiled modules in $XDG_CACHE_HOME/cs238"
+		       " (~/.cache/cs238), or in $JITC_CACHE if set\n");
+		printf("  -o  also save the parsed expression to file, which"
+		       " later runs take as @file\n");
+		printf("  --  end of options, for an expression that starts"
+		       " with '-'\n");
+		printf("functions: exp, log, sqrt, abs, sigmoid (x);"
+		       " pow, min, max (x, y)\n");
 		return -1;
 	}
-	generate(parser_dag(parser), file);
-	parser_close(parser);
-	fclose(file);
+	if (cache_init(cache)) {
+		/* not fatal, every expression is compiled from scratch */
+	}
 
-	/* JIT compile */
+	/* parse and bind */
 
-	if (jitc_compile(CFILE, SOFILE)) {
-		file_delete(CFILE);
+	if (!(session = session_open(n,
+				     argv + 1,
+				     argc - 1 - n,
+				     argv + 1 + n,
+				     fast_math))) {
 		TRACE(0);
 		return -1;
 	}
-	file_delete(CFILE);
 
-	/* dynamic load */
+	/* saved after optimization, a later @file parses nothing */
 
-	if (!(jitc = jitc_open(SOFILE)) ||
-	    !(fnc = (evaluate_t)jitc_lookup(jitc, "evaluate"))) {
-		file_delete(SOFILE);
-		jitc_close(jitc);
+	if (save && parser_save(session->parsers[0], save)) {
+		session_close(session);
 		TRACE(0);
 		return -1;
 	}
-	printf("%f\n", fnc());
+
+	/* a constant needs no code */
+
+	for (k=0; k<n; ++k) {
+		if (constant(session->parsers[k])) {
+			for (i=0; i<session->rows; ++i) {
+				session->out[k * session->rows + i] =
+					sigmoid(parser_dag(session->parsers[k])->val);
+			}
+		}
+	}
+
+	/* gradient, prints one row per line */
+
+	if (gradient) {
+		if (constant(session->parsers[0])) {
+			constant_gradient(session->tables[0], session->out[0]);
+		}
+		else {
+			profile(session, fast_math, &options);
+			if (evaluate_gradient(session->parsers[0],
+					      session->tables[0],
+					      &options)) {
+				session_close(session);
+				TRACE(0);
+				return -1;
+			}
+		}
+		session->rows = 0;
+	}
+
+	/* tiered, prints as it goes */
+
+	else if (tiered && !emit && !constant(session->parsers[0])) {
+		if (evaluate_tiered(session->parsers[0],
+				    session->tables[0],
+				    verbose)) {
+			session_close(session);
+			TRACE(0);
+			return -1;
+		}
+		session->rows = 0;
+	}
+
+	/* interpret when compiling would not pay off, else compile */
+
+	else {
+		r = 0;
+		if (emit && !emittable(session)) {
+			emit = compile = 0;
+			interpret = 1;
+		}
+		if (!emit && !compile &&
+		    (0 > (r = evaluate_interpreted(session, interpret, verbose)))) {
+			session_close(session);
+			TRACE(0);
+			return -1;
+		}
+		profile(session, fast_math, &options);
+		if (!r && evaluate_compiled(session, emit, &options)) {
+			session_close(session);
+			TRACE(0);
+			return -1;
+		}
+		if (!r && !emit && verbose) {
+			fprintf(stderr,
+				"gcc: -O%d%s%s\n",
+				options.opt,
+				options.native ? " -march=native" : "",
+				options.fast_math ? " -ffast-math" : "");
+			report_guards(session);
+		}
+	}
+	for (i=0; i<session->rows; ++i) {
+		for (k=0; k<n; ++k) {
+			printf("%s%f",
+			       k ? " " : "",
+			       session->out[k * session->rows + i]);
+		}
+		printf("\n");
+	}
+	if (verbose) {
+		jitc_cache_stats(&hits, &misses, &evictions);
+		fprintf(stderr,
+			"cache: %lu hit(s), %lu miss(es), %lu eviction(s)\n",
+			(unsigned long)hits,
+			(unsigned long)misses,
+			(unsigned long)evictions);
+	}
 
 	/* done */
 
-	file_delete(SOFILE);
-	jitc_close(jitc);
+	session_close(session);
 	return 0;
 }
@@ -7,22 +7,17 @@
  * parser.c
  */
 
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "arena.h"
 #include "lexer.h"
 #include "parser.h"
 
-#define MKD(p,d,o)					\
-	do {						\
-		size_t n = sizeof (struct parser_dag);	\
-		if (!((d) = malloc(n))) {		\
-			TRACE("out of memory");		\
-			return NULL;			\
-		}					\
-		memset((d), 0, n);			\
-		(d)->op = (o);				\
-		(d)->id = ++(p)->id;			\
-	}						\
-	while (0)
-
 #define TRACE_ONCE(p,m)				\
 	do {					\
 		if (!(p)->stop) {		\
@@ -38,22 +33,159 @@ struct parser {
 	uint64_t n; /* total tokens */
 	struct lexer *lexer;
 	struct parser_dag *dag;
+	struct arena *arena; /* holds everything, the parser included */
+	struct {
+		uint64_t size;
+		char **names;
+	} symbols;
+	struct {
+		uint64_t capacity;
+		struct parser_dag **dags; /* id -> node */
+		uint64_t *hashes;         /* id -> structural hash */
+	} nodes;
+	struct {
+		uint64_t size; /* power of 2 */
+		struct parser_dag **dags;
+	} table;
 };
 
-static void
-free_dag(struct parser_dag *dag)
+/**
+ * Nodes are hash-consed: mkd() returns the existing node when one with
+ * the same op, children and value was made before, so that identical
+ * subexpressions share a single id. Children are always made before
+ * their parents, hence ids 1..id form a topological order. Nodes are
+ * bump-allocated from the per-parse arena, so they sit in memory in id
+ * order, and the whole parse is released at once by parser_close().
+ */
+
+static uint64_t
+hash_node(const struct parser *parser, const struct parser_dag *dag)
+{
+	uint64_t h, c;
+
+	h = hash_update(HASH_INIT, &dag->op, sizeof (dag->op));
+	if (PARSER_DAG_VAL == dag->op) {
+		h = hash_update(h, &dag->val, sizeof (dag->val));
+	}
+	else if (PARSER_DAG_VAR == dag->op) {
+		h = hash_update(h, &dag->var, sizeof (dag->var));
+	}
+	c = dag->left ? parser->nodes.hashes[dag->left->id] : 0;
+	h = hash_update(h, &c, sizeof (c));
+	c = dag->right ? parser->nodes.hashes[dag->right->id] : 0;
+	h = hash_update(h, &c, sizeof (c));
+	return h;
+}
+
+static int /* BOOL */
+same_node(const struct parser_dag *a, const struct parser_dag *b)
+{
+	return (a->op == b->op) &&
+		(a->var == b->var) &&
+		(a->left == b->left) &&
+		(a->right == b->right) &&
+		!memcmp(&a->val, &b->val, sizeof (a->val));
+}
+
+static int
+grow(struct parser *parser)
+{
+	struct parser_dag **dags;
+	uint64_t *hashes;
+	uint64_t i, j, m, n;
+
+	/* node storage, indexed by id */
+
+	if ((uint64_t)parser->id + 1 >= parser->nodes.capacity) {
+		m = parser->nodes.capacity;
+		n = m ? (2 * m) : 64;
+		if (!(dags = arena_realloc(parser->arena,
+					   parser->nodes.dags,
+					   m * sizeof (dags[0]),
+					   n * sizeof (dags[0]))) ||
+		    !(hashes = arena_realloc(parser->arena,
+					     parser->nodes.hashes,
+					     m * sizeof (hashes[0]),
+					     n * sizeof (hashes[0])))) {
+			TRACE(0);
+			return -1;
+		}
+		parser->nodes.dags = dags;
+		parser->nodes.hashes = hashes;
+		parser->nodes.capacity = n;
+	}
+
+	/* hash table, kept at most half full */
+
+	if ((2 * ((uint64_t)parser->id + 1)) > parser->table.size) {
+		n = parser->table.size ? (2 * parser->table.size) : 128;
+		if (!(dags = arena_malloc(parser->arena, n * sizeof (dags[0])))) {
+			TRACE(0);
+			return -1;
+		}
+		memset(dags, 0, n * sizeof (dags[0]));
+		for (i=1; i<=(uint64_t)parser->id; ++i) {
+			j = parser->nodes.hashes[i] & (n - 1);
+			while (dags[j]) {
+				j = (j + 1) & (n - 1);
+			}
+			dags[j] = parser->nodes.dags[i];
+		}
+		parser->table.dags = dags;
+		parser->table.size = n;
+	}
+	return 0;
+}
+
+static struct parser_dag *
+mkd(struct parser *parser, const struct parser_dag *key)
 {
-	if (dag) {
-		free_dag(dag->left);
-		free_dag(dag->right);
+	struct parser_dag *dag;
+	uint64_t h, j;
+
+	if (grow(parser)) {
+		TRACE(0);
+		return NULL;
+	}
+	h = hash_node(parser, key);
+	j = h & (parser->table.size - 1);
+	while ((dag = parser->table.dags[j])) {
+		if (same_node(dag, key)) {
+			return dag;
+		}
+		j = (j + 1) & (parser->table.size - 1);
 	}
-	FREE(dag);
+	if (!(dag = arena_malloc(parser->arena, sizeof (struct parser_dag)))) {
+		TRACE(0);
+		return NULL;
+	}
+	memcpy(dag, key, sizeof (struct parser_dag));
+	dag->id = ++parser->id;
+	parser->nodes.dags[dag->id] = dag;
+	parser->nodes.hashes[dag->id] = h;
+	parser->table.dags[j] = dag;
+	return dag;
+}
+
+static struct parser_dag *
+mkop(struct parser *parser,
+     enum parser_dag_op op,
+     struct parser_dag *left,
+     struct parser_dag *right)
+{
+	struct parser_dag key;
+
+	memset(&key, 0, sizeof (struct parser_dag));
+	key.op = op;
+	key.left = left;
+	key.right = right;
+	return mkd(parser, &key);
 }
 
 static const struct lexer_token *
 next(const struct parser *parser)
 {
-	static const struct lexer_token SENTINEL = { LEXER_OP_, 0.0 };
+	static const struct lexer_token SENTINEL = { LEXER_OP_, 0.0, NULL };
 
 	if (parser->i < parser->n) {
 		return lexer_lookup(parser->lexer, parser->i);
@@ -80,191 +212,380 @@ forward(struct parser *parser)
 	}
 }
 
-/**
- * expr_primary : VAL
- *              | '(' expr ')'
- */
-
-static struct parser_dag *expr(struct parser *parser);
-
-static struct parser_dag *
-expr_primary(struct parser *parser)
+static int
+symbol(struct parser *parser, const char *name)
 {
-	struct parser_dag *dag;
+	char **names;
+	size_t n;
+	int i;
 
-	dag = NULL;
-	if (match(parser, LEXER_OP_VAL)) {
-		MKD(parser, dag, PARSER_DAG_VAL);
-		dag->val = next(parser)->val;
-		forward(parser);
+	if (0 <= (i = parser_symbol_find(parser, name))) {
+		return i;
 	}
-	else if (match(parser, LEXER_OP_OPEN)) {
-		forward(parser);
-		if (!(dag = expr(parser))) {
-			TRACE_ONCE(parser, "invalid sub-expression");
-			return NULL;
-		}
-		if (!match(parser, LEXER_OP_CLOSE)) {
-			TRACE_ONCE(parser, "expecting ')'");
-			return NULL;
+	if (0 == (parser->symbols.size % 16)) {
+		n = parser->symbols.size * sizeof (names[0]);
+		if (!(names = arena_realloc(parser->arena,
+					    parser->symbols.names,
+					    n,
+					    n + 16 * sizeof (names[0])))) {
+			TRACE(0);
+			return -1;
 		}
-		forward(parser);
+		parser->symbols.names = names;
 	}
-	return dag;
+	if (!(parser->symbols.names[parser->symbols.size] =
+	      arena_strndup(parser->arena, name, safe_strlen(name)))) {
+		TRACE(0);
+		return -1;
+	}
+	return (int)parser->symbols.size++;
 }
 
 /**
- * expr_unary : [ '+' '-' ] exr_unary
- *            | expr_primary
+ * expr                : expr_additive
+ * expr_additive       : expr_multiplicative { [ '+' '-' ] expr_multiplicative }
+ * expr_multiplicative : expr_unary { [ '*' '/' ] expr_unary }
+ * expr_unary          : [ '+' '-' ] expr_unary
+ *                     | expr_primary
+ * expr_primary        : VAL
+ *                     | VAR
+ *                     | FUNCTION '(' expr [ ',' expr ] ')'
+ *                     | '(' expr ')'
+ *
+ * Parsed by operator precedence over explicit stacks (shunting-yard), so
+ * neither deep nesting nor long operator chains use native stack. Operands
+ * wait on one stack, pending operators, unary '-' and '(' markers on the
+ * other. A binary operator first reduces every pending operator of no
+ * lower precedence, which makes binary operators left-associative. A
+ * call pushes its function as a marker that acts like '(' and is reduced
+ * as an operator by the closing ')'.
  */
 
-static struct parser_dag *
-expr_unary(struct parser *parser)
+#define OPEN PARSER_DAG_ /* '(' marker on the operator stack */
+
+static const struct {
+	const char *name;
+	enum parser_dag_op op;
+} FUNCTIONS[] = {
+	{ "exp", PARSER_DAG_EXP },
+	{ "log", PARSER_DAG_LOG },
+	{ "sqrt", PARSER_DAG_SQRT },
+	{ "abs", PARSER_DAG_ABS },
+	{ "sigmoid", PARSER_DAG_SIGMOID },
+	{ "pow", PARSER_DAG_POW },
+	{ "min", PARSER_DAG_MIN },
+	{ "max", PARSER_DAG_MAX }
+};
+
+struct stacks {
+	int plus; /* BOOL: the last token was a unary '+' */
+	uint64_t noperands;
+	uint64_t noperators;
+	struct parser_dag **operands;
+	enum parser_dag_op *operators;
+	char *commas; /* BOOL per operator: a call's ',' was seen */
+};
+
+static enum parser_dag_op
+function(const char *name)
 {
-	struct parser_dag *dag;
+	size_t i;
 
-	dag = NULL;
-	if (match(parser, LEXER_OP_ADD)) {
-		forward(parser);
-		if (!(dag = expr_unary(parser))) {
-			TRACE_ONCE(parser, "invalid unary '+' operand");
-			return NULL;
+	for (i=0; i<ARRAY_SIZE(FUNCTIONS); ++i) {
+		if (!strcmp(FUNCTIONS[i].name, name)) {
+			return FUNCTIONS[i].op;
 		}
 	}
-	else if (match(parser, LEXER_OP_SUB)) {
-		MKD(parser, dag, PARSER_DAG_NEG);
-		forward(parser);
-		if (!(dag->right = expr_unary(parser))) {
-			TRACE_ONCE(parser, "invalid unary '-' operand");
-			return NULL;
+	return PARSER_DAG_;
+}
+
+static const char *
+function_name(enum parser_dag_op op)
+{
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(FUNCTIONS); ++i) {
+		if (FUNCTIONS[i].op == op) {
+			return FUNCTIONS[i].name;
 		}
 	}
-	else {
-		dag = expr_primary(parser);
-	}
-	return dag;
+	return NULL;
 }
 
 /**
- * expr_multiplicative_ : { [ '*' '/' ] expr_unary expr_multiplicative_ }
- *                      | ∅
- *
- * expr_multiplicative : expr_unary expr_multiplicative_
+ * return: the number of operands of op, 1 for unary '-' and functions of
+ *         one argument
  */
 
-static struct parser_dag *
-expr_multiplicative_(struct parser *parser, struct parser_dag *left)
+static int
+arity(enum parser_dag_op op)
 {
-	const char * const TBL[] = { "*", "/" };
-	struct parser_dag *dag;
-	char buf[64];
+	switch (op) {
+	case PARSER_DAG_NEG:
+	case PARSER_DAG_EXP:
+	case PARSER_DAG_LOG:
+	case PARSER_DAG_SQRT:
+	case PARSER_DAG_ABS:
+	case PARSER_DAG_SIGMOID:
+		return 1;
+	default:
+		return 2;
+	}
+}
 
-	dag = left;
-	for (;;) {
-		if (match(parser, LEXER_OP_MUL)) {
-			MKD(parser, dag, PARSER_DAG_MUL);
-			dag->left = left;
-			forward(parser);
-		}
-		else if (match(parser, LEXER_OP_DIV)) {
-			MKD(parser, dag, PARSER_DAG_DIV);
-			dag->left = left;
-			forward(parser);
-		}
-		else {
-			break;
-		}
-		if (!(dag->right = expr_unary(parser))) {
-			safe_sprintf(buf,
-				     sizeof (buf),
-				     "invalid '%s' operand",
-				     TBL[dag->op - PARSER_DAG_MUL]);
-			TRACE_ONCE(parser, buf);
-			return NULL;
-		}
-		if (!(dag = expr_multiplicative_(parser, dag))) {
-			TRACE_ONCE(parser, 0);
-			return NULL;
-		}
+static int /* BOOL */
+marker(enum parser_dag_op op)
+{
+	return (OPEN == op) || function_name(op);
+}
+
+static int
+precedence(enum parser_dag_op op)
+{
+	switch (op) {
+	case PARSER_DAG_ADD:
+	case PARSER_DAG_SUB:
+		return 1;
+	case PARSER_DAG_MUL:
+	case PARSER_DAG_DIV:
+		return 2;
+	case PARSER_DAG_NEG:
+		return 3;
+	default:
+		return 0;
 	}
-	return dag;
 }
 
-static struct parser_dag *
-expr_multiplicative(struct parser *parser)
+static enum parser_dag_op
+binary(enum lexer_token_op op)
 {
-	struct parser_dag *dag;
+	switch (op) {
+	case LEXER_OP_ADD: return PARSER_DAG_ADD;
+	case LEXER_OP_SUB: return PARSER_DAG_SUB;
+	case LEXER_OP_MUL: return PARSER_DAG_MUL;
+	case LEXER_OP_DIV: return PARSER_DAG_DIV;
+	default:
+		return PARSER_DAG_;
+	}
+}
 
-	if (!(dag = expr_unary(parser))) {
-		return NULL;
+static int
+reduce(struct parser *parser, struct stacks *stacks)
+{
+	struct parser_dag *left, *right, *dag;
+	enum parser_dag_op op;
+
+	op = stacks->operators[--stacks->noperators];
+	right = stacks->operands[--stacks->noperands];
+	left = NULL;
+	if (1 != arity(op)) {
+		left = stacks->operands[--stacks->noperands];
+	}
+	if (!(dag = mkop(parser, op, left, right))) {
+		TRACE_ONCE(parser, 0);
+		return -1;
+	}
+	stacks->operands[stacks->noperands++] = dag;
+	return 0;
+}
+
+static int
+reduce_to(struct parser *parser, struct stacks *stacks, int level)
+{
+	while (stacks->noperators &&
+	       !marker(stacks->operators[stacks->noperators - 1]) &&
+	       (level <= precedence(stacks->operators[stacks->noperators - 1]))) {
+		if (reduce(parser, stacks)) {
+			return -1;
+		}
 	}
-	return expr_multiplicative_(parser, dag);
+	return 0;
 }
 
 /**
- * expr_additive_ : { [ '+' '-' ] expr_multiplicative expr_additive_ }
- *                | ∅
+ * Consumes one token where an operand is expected.
  *
- * expr_additive : expr_multiplicative expr_additive_
+ * return: 0 once an operand was pushed, 1 after a prefix ('(', a call's
+ *         name and '(', or unary '+' '-'), which still expects an
+ *         operand, negative on error
  */
 
-static struct parser_dag *
-expr_additive_(struct parser *parser, struct parser_dag *left)
+static int
+operand(struct parser *parser, struct stacks *stacks)
 {
-	const char * const TBL[] = { "+", "-" };
-	struct parser_dag *dag;
+	const char * const TBL[] = { "*", "/", "+", "-" };
+	struct parser_dag *dag, key;
+	enum parser_dag_op op;
 	char buf[64];
 
-	dag = left;
-	for (;;) {
-		if (match(parser, LEXER_OP_ADD)) {
-			MKD(parser, dag, PARSER_DAG_ADD);
-			dag->left = left;
-			forward(parser);
+	memset(&key, 0, sizeof (struct parser_dag));
+	if (match(parser, LEXER_OP_VAL)) {
+		key.op = PARSER_DAG_VAL;
+		key.val = next(parser)->val;
+		if (!(dag = mkd(parser, &key))) {
+			TRACE_ONCE(parser, 0);
+			return -1;
 		}
-		else if (match(parser, LEXER_OP_SUB)) {
-			MKD(parser, dag, PARSER_DAG_SUB);
-			dag->left = left;
-			forward(parser);
+		stacks->plus = 0;
+		stacks->operands[stacks->noperands++] = dag;
+		forward(parser);
+		return 0;
+	}
+	if (match(parser, LEXER_OP_VAR) &&
+	    (parser->i + 1 < parser->n) &&
+	    (LEXER_OP_OPEN == lexer_lookup(parser->lexer, parser->i + 1)->op) &&
+	    (PARSER_DAG_ != (op = function(next(parser)->name)))) {
+		stacks->commas[stacks->noperators] = 0;
+		stacks->operators[stacks->noperators++] = op;
+		stacks->plus = 0;
+		forward(parser);
+		forward(parser);
+		return 1;
+	}
+	if (match(parser, LEXER_OP_VAR)) {
+		key.op = PARSER_DAG_VAR;
+		if ((0 > (key.var = symbol(parser, next(parser)->name))) ||
+		    !(dag = mkd(parser, &key))) {
+			TRACE_ONCE(parser, 0);
+			return -1;
 		}
-		else {
-			break;
+		stacks->plus = 0;
+		stacks->operands[stacks->noperands++] = dag;
+		forward(parser);
+		return 0;
+	}
+	if (match(parser, LEXER_OP_OPEN)) {
+		stacks->operators[stacks->noperators++] = OPEN;
+	}
+	else if (match(parser, LEXER_OP_SUB)) {
+		stacks->operators[stacks->noperators++] = PARSER_DAG_NEG;
+	}
+	else if (!match(parser, LEXER_OP_ADD)) {
+		op = stacks->noperators ?
+			stacks->operators[stacks->noperators - 1] :
+			PARSER_DAG_;
+		if (stacks->plus) {
+			TRACE_ONCE(parser, "invalid unary '+' operand");
+		}
+		else if (PARSER_DAG_ == op) {
+			TRACE_ONCE(parser, stacks->noperators ?
+				   "invalid sub-expression" :
+				   "invalid expression");
 		}
-		if (!(dag->right = expr_multiplicative(parser))) {
+		else if (PARSER_DAG_NEG == op) {
+			TRACE_ONCE(parser, "invalid unary '-' operand");
+		}
+		else if (function_name(op)) {
 			safe_sprintf(buf,
 				     sizeof (buf),
-				     "invalid '%s' operand",
-				     TBL[dag->op - PARSER_DAG_MUL]);
+				     "invalid '%s' argument",
+				     function_name(op));
 			TRACE_ONCE(parser, buf);
-			return NULL;
 		}
-		if (!(dag = expr_additive_(parser, dag))) {
-			TRACE_ONCE(parser, 0);
-			return NULL;
+		else {
+			safe_sprintf(buf,
+				     sizeof (buf),
+				     "invalid '%s' operand",
+				     TBL[op - PARSER_DAG_MUL]);
+			TRACE_ONCE(parser, buf);
 		}
+		return -1;
 	}
-	return dag;
+	stacks->plus = match(parser, LEXER_OP_ADD);
+	forward(parser);
+	return 1;
 }
 
 static struct parser_dag *
-expr_additive(struct parser *parser)
+expr(struct parser *parser)
 {
 	struct parser_dag *dag;
+	struct stacks stacks;
+	enum parser_dag_op op;
+	int expecting; /* BOOL: an operand */
+	uint64_t n;
 
-	if (!(dag = expr_multiplicative(parser))) {
+	n = parser->n + 1;
+	memset(&stacks, 0, sizeof (struct stacks));
+	if (!(stacks.operands = malloc(n * sizeof (stacks.operands[0]))) ||
+	    !(stacks.operators = malloc(n * sizeof (stacks.operators[0]))) ||
+	    !(stacks.commas = malloc(n * sizeof (stacks.commas[0])))) {
+		FREE(stacks.operands);
+		FREE(stacks.operators);
+		TRACE_ONCE(parser, "out of memory");
 		return NULL;
 	}
-	return expr_additive_(parser, dag);
-}
-
-/**
- * expr : expr_additive
- */
-
-static struct parser_dag *
-expr(struct parser *parser)
-{
-	return expr_additive(parser);
+	dag = NULL;
+	expecting = 1;
+	for (;;) {
+		if (expecting) {
+			if (0 > (expecting = operand(parser, &stacks))) {
+				break;
+			}
+			continue;
+		}
+		if (PARSER_DAG_ != (op = binary(next(parser)->op))) {
+			if (reduce_to(parser, &stacks, precedence(op))) {
+				break;
+			}
+			stacks.operators[stacks.noperators++] = op;
+			forward(parser);
+			expecting = 1;
+		}
+		else if (match(parser, LEXER_OP_CLOSE)) {
+			if (reduce_to(parser, &stacks, 0)) {
+				break;
+			}
+			if (!stacks.noperators) {
+				/* unmatched, left to top() */
+				dag = stacks.operands[0];
+				break;
+			}
+			op = stacks.operators[stacks.noperators - 1];
+			if (OPEN == op) {
+				--stacks.noperators;
+			}
+			else if ((2 == arity(op)) &&
+				 !stacks.commas[stacks.noperators - 1]) {
+				TRACE_ONCE(parser, "expecting ','");
+				break;
+			}
+			else if (reduce(parser, &stacks)) {
+				break;
+			}
+			forward(parser);
+		}
+		else if (match(parser, LEXER_OP_COMMA)) {
+			if (reduce_to(parser, &stacks, 0)) {
+				break;
+			}
+			if (!stacks.noperators ||
+			    (2 != arity(op = stacks.operators[stacks.noperators - 1])) ||
+			    !function_name(op) ||
+			    stacks.commas[stacks.noperators - 1]) {
+				TRACE_ONCE(parser, "unexpected ','");
+				break;
+			}
+			stacks.commas[stacks.noperators - 1] = 1;
+			forward(parser);
+			expecting = 1;
+		}
+		else {
+			if (reduce_to(parser, &stacks, 0)) {
+				break;
+			}
+			if (stacks.noperators) {
+				TRACE_ONCE(parser, "expecting ')'");
+				break;
+			}
+			dag = stacks.operands[0];
+			break;
+		}
+	}
+	FREE(stacks.operands);
+	FREE(stacks.operators);
+	FREE(stacks.commas);
+	return dag;
 }
 
 /**
@@ -291,15 +612,19 @@ struct parser *
 parser_open(const char *s)
 {
 	struct parser *parser;
+	struct arena *arena;
 
 	assert( safe_strlen(s) );
 
-	if (!(parser = malloc(sizeof (struct parser)))) {
-		TRACE("out of memory");
+	if (!(arena = arena_open()) ||
+	    !(parser = arena_malloc(arena, sizeof (struct parser)))) {
+		arena_close(arena);
+		TRACE(0);
 		return NULL;
 	}
 	memset(parser, 0, sizeof (struct parser));
-	if (!(parser->lexer = lexer_open(s)) ||
+	parser->arena = arena;
+	if (!(parser->lexer = lexer_open(s, parser->arena)) ||
 	    !(parser->n = lexer_size(parser->lexer)) ||
 	    !(parser->dag = top(parser))) {
 		parser_close(parser);
@@ -315,11 +640,9 @@ void
 parser_close(struct parser *parser)
 {
 	if (parser) {
-		free_dag(parser->dag);
 		lexer_close(parser->lexer);
-		memset(parser, 0, sizeof (struct parser));
+		arena_close(parser->arena); /* parser included */
 	}
-	FREE(parser);
 }
 
 const struct parser_dag *
@@ -329,3 +652,602 @@ parser_dag(const struct parser *parser)
 
 	return parser->dag;
 }
+
+/**
+ * Optimization. Nodes are rebuilt bottom-up through mkd(), so rewritten
+ * subtrees stay hash-consed and untouched subtrees map onto themselves.
+ */
+
+static struct parser_dag *
+mkval(struct parser *parser, double val)
+{
+	struct parser_dag key;
+
+	memset(&key, 0, sizeof (struct parser_dag));
+	key.op = PARSER_DAG_VAL;
+	key.val = val;
+	return mkd(parser, &key);
+}
+
+static int /* BOOL */
+is_val(const struct parser_dag *dag, double val)
+{
+	return (PARSER_DAG_VAL == dag->op) && (val == dag->val);
+}
+
+static int /* BOOL */
+is_negative_zero(const struct parser_dag *dag)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &dag->val, sizeof (bits));
+	return is_val(dag, 0.0) && (bits >> 63);
+}
+
+/**
+ * return: 1/val if multiplying by it is exact, i.e. val is a power of two
+ *         whose reciprocal is a normal number, otherwise 0.0
+ */
+
+static double
+exact_reciprocal(double val)
+{
+	double r;
+	int e;
+
+	if ((0.5 != fabs(frexp(val, &e))) ||
+	    (-1022 > (1 - e)) ||
+	    (1023 < (1 - e))) {
+		return 0.0;
+	}
+	r = 1.0 / val;
+	return (0.5 == fabs(frexp(r, &e))) ? r : 0.0;
+}
+
+/**
+ * return: the value of a function call on constant arguments, computed as
+ *         the generated code does (b is the only argument of a unary one)
+ */
+
+static double
+call(enum parser_dag_op op, double a, double b)
+{
+	switch (op) {
+	case PARSER_DAG_EXP: return exp(b);
+	case PARSER_DAG_LOG: return log(b);
+	case PARSER_DAG_SQRT: return sqrt(b);
+	case PARSER_DAG_ABS: return fabs(b);
+	case PARSER_DAG_SIGMOID: return 1.0 / (1.0 + exp(- b));
+	case PARSER_DAG_POW: return pow(a, b);
+	case PARSER_DAG_MIN: return (a < b) ? a : b;
+	case PARSER_DAG_MAX: return (a > b) ? a : b;
+	default:
+		EXIT("software");
+	}
+	return 0.0;
+}
+
+static struct parser_dag *
+fold(struct parser *parser,
+     enum parser_dag_op op,
+     struct parser_dag *l,
+     struct parser_dag *r,
+     int fast_math)
+{
+	double a, b;
+
+	if (function_name(op)) {
+		if ((PARSER_DAG_VAL == r->op) && (!l || (PARSER_DAG_VAL == l->op))) {
+			return mkval(parser, call(op, l ? l->val : 0.0, r->val));
+		}
+		if ((PARSER_DAG_ABS == op) && (PARSER_DAG_NEG == r->op)) {
+			return fold(parser, op, NULL, r->right, fast_math);
+		}
+		return mkop(parser, op, l, r);
+	}
+	if (PARSER_DAG_NEG == op) {
+		if (PARSER_DAG_VAL == r->op) {
+			return mkval(parser, - r->val);
+		}
+		if (PARSER_DAG_NEG == r->op) {
+			return r->right;
+		}
+		return mkop(parser, op, NULL, r);
+	}
+	if ((PARSER_DAG_VAL == l->op) && (PARSER_DAG_VAL == r->op)) {
+		a = l->val;
+		b = r->val;
+		if (PARSER_DAG_MUL == op) {
+			return mkval(parser, a * b);
+		}
+		if (PARSER_DAG_DIV == op) {
+			return mkval(parser, b ? (a / b) : 0.0);
+		}
+		if (PARSER_DAG_ADD == op) {
+			return mkval(parser, a + b);
+		}
+		if (PARSER_DAG_SUB == op) {
+			return mkval(parser, a - b);
+		}
+		EXIT("software");
+	}
+	if (PARSER_DAG_MUL == op) {
+		if (is_val(r, 1.0)) {
+			return l;
+		}
+		if (is_val(l, 1.0)) {
+			return r;
+		}
+		if (is_val(r, -1.0)) {
+			return fold(parser, PARSER_DAG_NEG, NULL, l, fast_math);
+		}
+		if (is_val(l, -1.0)) {
+			return fold(parser, PARSER_DAG_NEG, NULL, r, fast_math);
+		}
+		if ((PARSER_DAG_NEG == l->op) && (PARSER_DAG_NEG == r->op)) {
+			return fold(parser, op, l->right, r->right, fast_math);
+		}
+		if (fast_math && (is_val(l, 0.0) || is_val(r, 0.0))) {
+			return mkval(parser, 0.0);
+		}
+	}
+	else if (PARSER_DAG_DIV == op) {
+		if (is_val(r, 0.0)) {
+			return mkval(parser, 0.0); /* the division guard */
+		}
+		if (is_val(r, 1.0)) {
+			return l;
+		}
+		if (PARSER_DAG_VAL == r->op) {
+			if ((b = exact_reciprocal(r->val)) ||
+			    (fast_math && (b = 1.0 / r->val))) {
+				return fold(parser,
+					    PARSER_DAG_MUL,
+					    l,
+					    mkval(parser, b),
+					    fast_math);
+			}
+		}
+	}
+	else if (PARSER_DAG_ADD == op) {
+		if (PARSER_DAG_NEG == r->op) {
+			return fold(parser, PARSER_DAG_SUB, l, r->right, fast_math);
+		}
+		if (PARSER_DAG_NEG == l->op) {
+			return fold(parser, PARSER_DAG_SUB, r, l->right, fast_math);
+		}
+		if (is_negative_zero(r) || (fast_math && is_val(r, 0.0))) {
+			return l;
+		}
+		if (is_negative_zero(l) || (fast_math && is_val(l, 0.0))) {
+			return r;
+		}
+	}
+	else if (PARSER_DAG_SUB == op) {
+		if (PARSER_DAG_NEG == r->op) {
+			return fold(parser, PARSER_DAG_ADD, l, r->right, fast_math);
+		}
+		if ((is_val(r, 0.0) && !is_negative_zero(r)) ||
+		    (fast_math && is_val(r, 0.0))) {
+			return l;
+		}
+		if (fast_math && (l == r)) {
+			return mkval(parser, 0.0);
+		}
+		if (fast_math && is_val(l, 0.0)) {
+			return fold(parser, PARSER_DAG_NEG, NULL, r, fast_math);
+		}
+	}
+	return mkop(parser, op, l, r);
+}
+
+int
+parser_optimize(struct parser *parser, int fast_math)
+{
+	struct parser_dag **map, *dag, *l, *r;
+	uint64_t i, n;
+
+	assert( parser && parser->dag );
+
+	n = (uint64_t)parser->id;
+	if (!(map = malloc((n + 1) * sizeof (map[0])))) {
+		TRACE("out of memory");
+		return -1;
+	}
+	for (i=1; i<=n; ++i) {
+		dag = parser->nodes.dags[i];
+		if ((PARSER_DAG_VAL == dag->op) || (PARSER_DAG_VAR == dag->op)) {
+			map[i] = dag;
+			continue;
+		}
+		l = dag->left ? map[dag->left->id] : NULL;
+		r = dag->right ? map[dag->right->id] : NULL;
+		if (!(map[i] = fold(parser, dag->op, l, r, fast_math))) {
+			FREE(map);
+			TRACE(0);
+			return -1;
+		}
+	}
+	parser->dag = map[parser->dag->id];
+	FREE(map);
+	return 0;
+}
+
+uint64_t
+parser_hash(const struct parser *parser)
+{
+	uint64_t h;
+
+	assert( parser );
+
+	h = hash_update(HASH_INIT,
+			&parser->symbols.size,
+			sizeof (parser->symbols.size));
+	return hash_update(h,
+			   &parser->nodes.hashes[parser->dag->id],
+			   sizeof (parser->nodes.hashes[0]));
+}
+
+uint64_t
+parser_size(const struct parser *parser)
+{
+	assert( parser );
+
+	return (uint64_t)parser->id;
+}
+
+const struct parser_dag *
+parser_node(const struct parser *parser, uint64_t id)
+{
+	assert( parser );
+	assert( id && (id <= (uint64_t)parser->id) );
+
+	return parser->nodes.dags[id];
+}
+
+uint64_t
+parser_order(const struct parser *parser, const struct parser_dag **nodes)
+{
+	const struct parser_dag *dag;
+	uint64_t i, m;
+	char *reachable;
+
+	assert( parser && parser->dag && nodes );
+
+	if (!(reachable = malloc((uint64_t)parser->id + 1))) {
+		TRACE("out of memory");
+		return 0;
+	}
+	memset(reachable, 0, (uint64_t)parser->id + 1);
+	reachable[parser->dag->id] = 1;
+	for (i=(uint64_t)parser->id; 0<i; --i) {
+		dag = parser->nodes.dags[i];
+		if (reachable[i]) {
+			if (dag->left) {
+				reachable[dag->left->id] = 1;
+			}
+			if (dag->right) {
+				reachable[dag->right->id] = 1;
+			}
+		}
+	}
+	for (i=1, m=0; i<=(uint64_t)parser->id; ++i) {
+		if (reachable[i]) {
+			nodes[m++] = parser->nodes.dags[i];
+		}
+	}
+	FREE(reachable);
+	return m;
+}
+
+uint64_t
+parser_symbol_size(const struct parser *parser)
+{
+	assert( parser );
+
+	return parser->symbols.size;
+}
+
+const char *
+parser_symbol_lookup(const struct parser *parser, uint64_t i)
+{
+	assert( parser );
+	assert( i < parser->symbols.size );
+
+	return parser->symbols.names[i];
+}
+
+int
+parser_symbol_find(const struct parser *parser, const char *name)
+{
+	uint64_t i;
+
+	assert( parser );
+
+	for (i=0; i<parser->symbols.size; ++i) {
+		if (!strcmp(parser->symbols.names[i], name)) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * The format of parser_save(), in host byte order: a header, the nodes
+ * reachable from the root in id order, so children come first and the
+ * root last, and then the symbol names, each NUL-terminated, in symbol
+ * table order. Nodes name their children by 1-based position in the
+ * array, 0 for none. Files are meant for the machine that wrote them, a
+ * foreign byte order fails the magic check.
+ */
+
+#define FILE_MAGIC 0x4741443833325343UL /* "CS238DAG" */
+#define FILE_VERSION 1
+
+struct file_header {
+	uint64_t magic;
+	uint64_t version;
+	uint64_t nodes;
+	uint64_t symbols;
+	uint64_t names; /* bytes */
+};
+
+struct file_node {
+	double val;
+	uint32_t op;
+	uint32_t var;
+	uint32_t left;
+	uint32_t right;
+};
+
+static int
+save(const struct parser *parser, FILE *file)
+{
+	const struct parser_dag **nodes;
+	struct file_header header;
+	struct file_node node;
+	uint32_t *position; /* id -> 1-based position */
+	uint64_t i, m;
+
+	nodes = NULL;
+	if (!(nodes = malloc(parser_size(parser) * sizeof (nodes[0]))) ||
+	    !(position = malloc((parser_size(parser) + 1) *
+				sizeof (position[0])))) {
+		FREE(nodes);
+		TRACE("out of memory");
+		return -1;
+	}
+	if (!(m = parser_order(parser, nodes))) {
+		FREE(nodes);
+		FREE(position);
+		TRACE(0);
+		return -1;
+	}
+	memset(&header, 0, sizeof (struct file_header));
+	header.magic = FILE_MAGIC;
+	header.version = FILE_VERSION;
+	header.nodes = m;
+	header.symbols = parser->symbols.size;
+	for (i=0; i<parser->symbols.size; ++i) {
+		header.names += safe_strlen(parser->symbols.names[i]) + 1;
+	}
+	if (1 != fwrite(&header, sizeof (header), 1, file)) {
+		FREE(nodes);
+		FREE(position);
+		TRACE("fwrite()");
+		return -1;
+	}
+	for (i=0; i<m; ++i) {
+		position[nodes[i]->id] = (uint32_t)(i + 1);
+		memset(&node, 0, sizeof (struct file_node));
+		node.op = (uint32_t)nodes[i]->op;
+		if (PARSER_DAG_VAL == nodes[i]->op) {
+			node.val = nodes[i]->val;
+		}
+		if (PARSER_DAG_VAR == nodes[i]->op) {
+			node.var = (uint32_t)nodes[i]->var;
+		}
+		node.left = nodes[i]->left ? position[nodes[i]->left->id] : 0;
+		node.right = nodes[i]->right ? position[nodes[i]->right->id] : 0;
+		if (1 != fwrite(&node, sizeof (node), 1, file)) {
+			FREE(nodes);
+			FREE(position);
+			TRACE("fwrite()");
+			return -1;
+		}
+	}
+	FREE(nodes);
+	FREE(position);
+	for (i=0; i<parser->symbols.size; ++i) {
+		if (1 != fwrite(parser->symbols.names[i],
+				safe_strlen(parser->symbols.names[i]) + 1,
+				1,
+				file)) {
+			TRACE("fwrite()");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int
+parser_save(const struct parser *parser, const char *pathname)
+{
+	char *temp;
+	size_t n;
+	FILE *file;
+
+	assert( parser && parser->dag );
+	assert( safe_strlen(pathname) );
+
+	n = safe_strlen(pathname) + 32;
+	if (!(temp = malloc(n))) {
+		TRACE("out of memory");
+		return -1;
+	}
+	safe_sprintf(temp, n, "%s.%ld", pathname, (long)getpid());
+	if (!(file = fopen(temp, "w"))) {
+		FREE(temp);
+		TRACE("fopen()");
+		return -1;
+	}
+
+	/* publish atomically, a reader never maps a partial file */
+
+	if (save(parser, file) ||
+	    fclose(file) ||
+	    rename(temp, pathname)) {
+		file_delete(temp);
+		FREE(temp);
+		TRACE(0);
+		return -1;
+	}
+	FREE(temp);
+	return 0;
+}
+
+/**
+ * return: true if node, the i-th (1-based), has an operator with the
+ *         right operands, all at earlier positions, and a valid symbol
+ */
+
+static int /* BOOL */
+valid(const struct file_node *node, uint64_t i, uint64_t symbols)
+{
+	if ((PARSER_DAG_VAL > node->op) || (PARSER_DAG_MAX < node->op)) {
+		return 0;
+	}
+	if ((node->left >= i) || (node->right >= i)) {
+		return 0;
+	}
+	if (PARSER_DAG_VAL == node->op) {
+		return !node->left && !node->right;
+	}
+	if (PARSER_DAG_VAR == node->op) {
+		return !node->left && !node->right && (node->var < symbols);
+	}
+	if (1 == arity((enum parser_dag_op)node->op)) {
+		return !node->left && node->right;
+	}
+	return node->left && node->right;
+}
+
+/**
+ * Rebuilds the DAG of a mapped file through mkd(), so the result is
+ * hash-consed and numbered as if parsed (parser_hash() matches) and can
+ * be optimized further.
+ */
+
+static int
+load(struct parser *parser, const char *base, uint64_t size)
+{
+	const struct file_header *header;
+	const struct file_node *nodes;
+	struct parser_dag **map, key;
+	const char *names, *end;
+	uint64_t i;
+
+	header = (const struct file_header *)base;
+	if ((sizeof (struct file_header) > size) ||
+	    (FILE_MAGIC != header->magic) ||
+	    (FILE_VERSION != header->version) ||
+	    !header->nodes ||
+	    (header->nodes > ((size - sizeof (struct file_header)) /
+			      sizeof (struct file_node))) ||
+	    (header->names != (size -
+			       sizeof (struct file_header) -
+			       header->nodes * sizeof (struct file_node))) ||
+	    (header->symbols > header->names)) {
+		TRACE("invalid DAG file");
+		return -1;
+	}
+	nodes = (const struct file_node *)(header + 1);
+	names = (const char *)(nodes + header->nodes);
+	end = names + header->names;
+	for (i=0; i<header->symbols; ++i) {
+		if (!memchr(names, '\0', end - names) ||
+		    ((uint64_t)symbol(parser, names) != i)) {
+			TRACE("invalid DAG file");
+			return -1;
+		}
+		names += safe_strlen(names) + 1;
+	}
+	if (names != end) {
+		TRACE("invalid DAG file");
+		return -1;
+	}
+	if (!(map = malloc((header->nodes + 1) * sizeof (map[0])))) {
+		TRACE("out of memory");
+		return -1;
+	}
+	for (i=1; i<=header->nodes; ++i) {
+		if (!valid(&nodes[i - 1], i, header->symbols)) {
+			FREE(map);
+			TRACE("invalid DAG file");
+			return -1;
+		}
+		memset(&key, 0, sizeof (struct parser_dag));
+		key.op = (enum parser_dag_op)nodes[i - 1].op;
+		if (PARSER_DAG_VAL == key.op) {
+			key.val = nodes[i - 1].val;
+		}
+		if (PARSER_DAG_VAR == key.op) {
+			key.var = (int)nodes[i - 1].var;
+		}
+		key.left = nodes[i - 1].left ? map[nodes[i - 1].left] : NULL;
+		key.right = nodes[i - 1].right ? map[nodes[i - 1].right] : NULL;
+		if (!(map[i] = mkd(parser, &key))) {
+			FREE(map);
+			TRACE(0);
+			return -1;
+		}
+	}
+	parser->dag = map[header->nodes];
+	FREE(map);
+	return 0;
+}
+
+struct parser *
+parser_load(const char *pathname)
+{
+	struct parser *parser;
+	struct arena *arena;
+	struct stat st;
+	void *base;
+	int fd;
+
+	assert( safe_strlen(pathname) );
+
+	if (0 > (fd = open(pathname, O_RDONLY))) {
+		TRACE("open()");
+		return NULL;
+	}
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		TRACE("invalid DAG file");
+		return NULL;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == base) {
+		TRACE("mmap()");
+		return NULL;
+	}
+	if (!(arena = arena_open()) ||
+	    !(parser = arena_malloc(arena, sizeof (struct parser)))) {
+		arena_close(arena);
+		munmap(base, st.st_size);
+		TRACE(0);
+		return NULL;
+	}
+	memset(parser, 0, sizeof (struct parser));
+	parser->arena = arena;
+	if (load(parser, (const char *)base, (uint64_t)st.st_size)) {
+		parser_close(parser);
+		munmap(base, st.st_size);
+		TRACE(0);
+		return NULL;
+	}
+	munmap(base, st.st_size);
+	return parser;
+}
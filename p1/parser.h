@@ -10,17 +10,29 @@
 #ifndef _PARSER_H_
 #define _PARSER_H_
 
+#include "system.h"
+
 struct parser_dag {
 	enum parser_dag_op {
 		PARSER_DAG_,
 		PARSER_DAG_VAL, /* val */
+		PARSER_DAG_VAR, /* vars[var] */
 		PARSER_DAG_NEG, /* - right */
 		PARSER_DAG_MUL, /* left * right */
 		PARSER_DAG_DIV, /* left / right */
 		PARSER_DAG_ADD, /* left + right */
-		PARSER_DAG_SUB  /* left - right */
+		PARSER_DAG_SUB, /* left - right */
+		PARSER_DAG_EXP,     /* exp(right) */
+		PARSER_DAG_LOG,     /* log(right) */
+		PARSER_DAG_SQRT,    /* sqrt(right) */
+		PARSER_DAG_ABS,     /* fabs(right) */
+		PARSER_DAG_SIGMOID, /* 1 / (1 + exp(- right)) */
+		PARSER_DAG_POW,     /* pow(left, right) */
+		PARSER_DAG_MIN,     /* (left < right) ? left : right */
+		PARSER_DAG_MAX      /* (left > right) ? left : right */
 	} op;
-	int id; /* guaranteed to be unique */
+	int id; /* guaranteed to be unique, shared by identical subtrees */
+	int var; /* index into the symbol table */
 	double val;
 	struct parser_dag *left;
 	struct parser_dag *right;
@@ -28,10 +40,112 @@ struct parser_dag {
 
 struct parser;
 
+/**
+ * Parses an expression of numbers, variables, '+' '-' '*' '/' (unary
+ * '+' '-' included), parentheses and the calls exp(x), log(x), sqrt(x),
+ * abs(x), sigmoid(x), pow(x, y), min(x, y) and max(x, y). A function name
+ * is only a call when followed by '(', otherwise it is a variable. min and
+ * max return y when x and y are unordered, as minsd/maxsd do.
+ *
+ * return: an opaque handle or NULL on error
+ */
+
 struct parser *parser_open(const char *s);
 
 void parser_close(struct parser *parser);
 
+/**
+ * Writes the expression reachable from parser_dag(), optimized or not,
+ * and the symbol table to a compact binary file: a topologically ordered
+ * array of nodes with child indices. The file is replaced atomically.
+ *
+ * return: 0 on success, otherwise error
+ */
+
+int parser_save(const struct parser *parser, const char *pathname);
+
+/**
+ * Reads a file written by parser_save() on this machine. The file is
+ * memory-mapped and its nodes are linked up directly, with no lexing or
+ * number conversion. The result is equivalent to the parser that was
+ * saved: same expression, symbol table and parser_hash(), though node
+ * ids may be renumbered. Malformed files are rejected.
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct parser *parser_load(const char *pathname);
+
 const struct parser_dag *parser_dag(const struct parser *parser);
 
+/**
+ * Identical subexpressions are represented by a single node, making the
+ * result a true DAG. Node ids range over 1..parser_size() and every node's
+ * children have smaller ids than the node itself. After parser_optimize()
+ * some of these nodes may no longer be reachable from parser_dag().
+ *
+ * return: the number of distinct nodes made so far
+ */
+
+uint64_t parser_size(const struct parser *parser);
+
+/**
+ * return: the node with the given id, 1 <= id <= parser_size()
+ */
+
+const struct parser_dag *parser_node(const struct parser *parser, uint64_t id);
+
+/**
+ * Lists the nodes reachable from parser_dag() in ascending id order, so
+ * that children come before their parents and shared nodes appear once.
+ * Takes linear time and no recursion, whatever the depth of the DAG.
+ *
+ * nodes: receives at most parser_size() nodes
+ *
+ * return: the number of nodes stored, 0 on error
+ */
+
+uint64_t parser_order(const struct parser *parser,
+		      const struct parser_dag **nodes);
+
+/**
+ * Rewrites the expression: folds constant subexpressions (with the same
+ * b ? (a / b) : 0.0 semantics as the generated code) and applies algebraic
+ * identities that are exact in IEEE-754 arithmetic, e.g. x*1, x/1, x-0,
+ * - -x, x - -y, abs(-x) and division by a power of two as a
+ * multiplication. Calls on constants are evaluated with the C library. With
+ * fast_math set, also applies identities that fail for infinities, NaNs
+ * or signed zeros, e.g. x-x, x*0, x+0, and replaces division by any other
+ * constant with multiplication by its reciprocal.
+ *
+ * return: 0 on success, otherwise error
+ */
+
+int parser_optimize(struct parser *parser, int fast_math);
+
+/**
+ * return: a hash of the expression's structure (operators, constants,
+ *         variable indices and symbol count) that is equal for any two
+ *         inputs that generate the same code, e.g. "a+2" and "x + 2.0"
+ */
+
+uint64_t parser_hash(const struct parser *parser);
+
+/**
+ * The symbol table holds the distinct variable names referenced by the
+ * expression, in order of first appearance. A PARSER_DAG_VAR node's var
+ * field is an index into this table, and the compiled evaluate() reads
+ * that variable's value from vars[var].
+ */
+
+uint64_t parser_symbol_size(const struct parser *parser);
+
+const char *parser_symbol_lookup(const struct parser *parser, uint64_t i);
+
+/**
+ * return: the symbol table index of name, or -1 if not referenced
+ */
+
+int parser_symbol_find(const struct parser *parser, const char *name);
+
 #endif /* _PARSER_H_ */
@@ -0,0 +1,297 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * range.c
+ */
+
+#include <math.h>
+#include "range.h"
+
+/**
+ * Bounds are computed with the same IEEE-754 operations as the generated
+ * code. Correctly rounded operations are monotone in each operand, so
+ * their bounds need no widening. Library calls (exp, log) are only
+ * accurate to about one ulp, so their bounds are widened by SLACK
+ * relative to the result. A bound that comes out NaN, e.g. inf - inf,
+ * is widened to the infinity on its side.
+ */
+
+#define SLACK 1e-12
+
+/* below this, exp() may be subnormal and SLACK may not cover its error */
+
+#define EXP_MIN -700.0
+
+struct interval {
+	double lo;
+	double hi;
+};
+
+struct range {
+	uint64_t size;
+	struct interval *intervals; /* indexed by node id */
+};
+
+static double
+lower(double x)
+{
+	return (x != x) ? -HUGE_VAL : x;
+}
+
+static double
+upper(double x)
+{
+	return (x != x) ? HUGE_VAL : x;
+}
+
+static double
+down(double x)
+{
+	return lower(x - fabs(x) * SLACK);
+}
+
+static double
+up(double x)
+{
+	return upper(x + fabs(x) * SLACK);
+}
+
+static void
+full(struct interval *r)
+{
+	r->lo = -HUGE_VAL;
+	r->hi = HUGE_VAL;
+}
+
+static int /* BOOL */
+nonzero(const struct interval *r)
+{
+	return (0.0 < r->lo) || (0.0 > r->hi);
+}
+
+/**
+ * The hull of a op b over the corners of a and b, which holds for
+ * multiplication and, when b excludes zero, for division.
+ */
+
+static void
+corners(const struct interval *a,
+	const struct interval *b,
+	int divide,
+	struct interval *r)
+{
+	double p[4];
+	int i;
+
+	p[0] = divide ? (a->lo / b->lo) : (a->lo * b->lo);
+	p[1] = divide ? (a->lo / b->hi) : (a->lo * b->hi);
+	p[2] = divide ? (a->hi / b->lo) : (a->hi * b->lo);
+	p[3] = divide ? (a->hi / b->hi) : (a->hi * b->hi);
+	r->lo = p[0];
+	r->hi = p[0];
+	for (i=0; i<4; ++i) {
+		if (p[i] != p[i]) {
+			/* 0 * inf or inf / inf */
+			full(r);
+			return;
+		}
+		r->lo = (p[i] < r->lo) ? p[i] : r->lo;
+		r->hi = (p[i] > r->hi) ? p[i] : r->hi;
+	}
+}
+
+static double
+sigmoid(double x)
+{
+	return 1.0 / (1.0 + exp(- x));
+}
+
+/**
+ * Computes r, the interval of dag, from the intervals of its operands. An
+ * interval bounds the non-NaN values only, NaN has no place in it; min
+ * and max, which may turn a NaN operand into the other one, take the hull
+ * of both.
+ */
+
+static void
+bound(const struct range *range,
+      const struct parser_dag *dag,
+      struct interval *r)
+{
+	struct interval a, b;
+
+	full(&a);
+	full(&b);
+	if (dag->left) {
+		a = range->intervals[dag->left->id];
+	}
+	if (dag->right) {
+		b = range->intervals[dag->right->id];
+	}
+	switch (dag->op) {
+	case PARSER_DAG_VAL:
+		if (dag->val != dag->val) {
+			full(r);
+		}
+		else {
+			r->lo = dag->val;
+			r->hi = dag->val;
+		}
+		break;
+	case PARSER_DAG_VAR:
+		full(r);
+		break;
+	case PARSER_DAG_NEG:
+		r->lo = - b.hi;
+		r->hi = - b.lo;
+		break;
+	case PARSER_DAG_MUL:
+		corners(&a, &b, 0, r);
+		if ((dag->left == dag->right) && (0.0 > r->lo)) {
+			/* x * x, identical operands are one node */
+			r->lo = 0.0;
+		}
+		break;
+	case PARSER_DAG_DIV:
+		if (nonzero(&b)) {
+			corners(&a, &b, 1, r);
+		}
+		else {
+			full(r);
+		}
+		break;
+	case PARSER_DAG_ADD:
+		r->lo = lower(a.lo + b.lo);
+		r->hi = upper(a.hi + b.hi);
+		break;
+	case PARSER_DAG_SUB:
+		r->lo = lower(a.lo - b.hi);
+		r->hi = upper(a.hi - b.lo);
+		break;
+	case PARSER_DAG_EXP:
+		r->lo = (EXP_MIN < b.lo) ? down(exp(b.lo)) : 0.0;
+		r->hi = up(exp(b.hi));
+		break;
+	case PARSER_DAG_LOG:
+		r->lo = (0.0 < b.lo) ? down(log(b.lo)) : -HUGE_VAL;
+		r->hi = (0.0 < b.hi) ? up(log(b.hi)) : -HUGE_VAL;
+		break;
+	case PARSER_DAG_SQRT:
+		r->lo = (0.0 < b.lo) ? sqrt(b.lo) : 0.0;
+		r->hi = (0.0 < b.hi) ? sqrt(b.hi) : 0.0;
+		break;
+	case PARSER_DAG_ABS:
+		if (0.0 <= b.lo) {
+			r->lo = b.lo;
+			r->hi = b.hi;
+		}
+		else if (0.0 >= b.hi) {
+			r->lo = - b.hi;
+			r->hi = - b.lo;
+		}
+		else {
+			r->lo = 0.0;
+			r->hi = (- b.lo > b.hi) ? - b.lo : b.hi;
+		}
+		break;
+	case PARSER_DAG_SIGMOID:
+		r->lo = (EXP_MIN < b.lo) ? down(sigmoid(b.lo)) : 0.0;
+		r->hi = 1.0;
+		break;
+	case PARSER_DAG_POW:
+		/* pow(-0.0, -1.0) is -inf, a positive base is a must */
+		if (0.0 < a.lo) {
+			r->lo = 0.0;
+			r->hi = HUGE_VAL;
+		}
+		else {
+			full(r);
+		}
+		break;
+	case PARSER_DAG_MIN:
+	case PARSER_DAG_MAX:
+		r->lo = (a.lo < b.lo) ? a.lo : b.lo;
+		r->hi = (a.hi > b.hi) ? a.hi : b.hi;
+		break;
+	default:
+		EXIT("software");
+	}
+}
+
+struct range *
+range_open(const struct parser *parser)
+{
+	struct range *range;
+	uint64_t i;
+
+	assert( parser );
+
+	if (!(range = malloc(sizeof (struct range)))) {
+		TRACE("out of memory");
+		return NULL;
+	}
+	memset(range, 0, sizeof (struct range));
+	range->size = parser_size(parser);
+	if (!(range->intervals = malloc((range->size + 1) *
+					sizeof (range->intervals[0])))) {
+		range_close(range);
+		TRACE("out of memory");
+		return NULL;
+	}
+	for (i=1; i<=range->size; ++i) {
+		bound(range, parser_node(parser, i), &range->intervals[i]);
+	}
+	return range;
+}
+
+void
+range_close(struct range *range)
+{
+	if (range) {
+		FREE(range->intervals);
+		memset(range, 0, sizeof (struct range));
+	}
+	FREE(range);
+}
+
+int
+range_nonzero(const struct range *range, const struct parser_dag *dag)
+{
+	assert( range && dag );
+	assert( dag->id && ((uint64_t)dag->id <= range->size) );
+
+	return nonzero(&range->intervals[dag->id]);
+}
+
+void
+range_guards(const struct range *range,
+	     const struct parser *parser,
+	     uint64_t *divisions,
+	     uint64_t *proven)
+{
+	const struct parser_dag **nodes;
+	uint64_t i, m, d, p;
+
+	assert( range && parser );
+
+	d = p = 0;
+	if ((nodes = malloc(parser_size(parser) * sizeof (nodes[0])))) {
+		m = parser_order(parser, nodes);
+		for (i=0; i<m; ++i) {
+			if (PARSER_DAG_DIV == nodes[i]->op) {
+				++d;
+				p += range_nonzero(range, nodes[i]->right) ? 1 : 0;
+			}
+		}
+		FREE(nodes);
+	}
+	if (divisions) {
+		(*divisions) = d;
+	}
+	if (proven) {
+		(*proven) = p;
+	}
+}
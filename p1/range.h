@@ -0,0 +1,56 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * range.h
+ */
+
+#ifndef _RANGE_H_
+#define _RANGE_H_
+
+#include "parser.h"
+
+struct range;
+
+/**
+ * Interval analysis: bounds the value of every node of the expression,
+ * bottom-up in one pass over the node ids, assuming nothing about the
+ * variables. The bounds hold for every non-NaN value the generated code
+ * can compute, infinities and rounding included, so a node whose
+ * interval excludes zero never evaluates to 0.0 or -0.0.
+ *
+ * parser: the parsed expression, not referenced after this call
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct range *range_open(const struct parser *parser);
+
+/**
+ * Note: range may be NULL
+ */
+
+void range_close(struct range *range);
+
+/**
+ * return: true if dag is proven never to be zero, so that dividing by it
+ *         needs no b ? (a / b) : 0.0 guard
+ */
+
+int range_nonzero(const struct range *range, const struct parser_dag *dag);
+
+/**
+ * Counts the divisions reachable from parser_dag().
+ *
+ * divisions: receives the number of divisions, or NULL
+ * proven   : receives how many of them need no guard, or NULL
+ */
+
+void range_guards(const struct range *range,
+		  const struct parser *parser,
+		  uint64_t *divisions,
+		  uint64_t *proven);
+
+#endif /* _RANGE_H_ */
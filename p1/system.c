@@ -10,12 +10,14 @@
 #define _GNU_SOURCE
 
 #include <unistd.h>
+#include <time.h>
 #include "system.h"
 
 /**
  * Needs:
  *   unlink()
  *   vsnprintf()
+ *   clock_gettime()
  */
 
 void
@@ -28,6 +30,30 @@ file_delete(const char *pathname)
 	}
 }
 
+uint64_t
+hash_update(uint64_t h, const void *p, size_t n)
+{
+	const unsigned char *s = (const unsigned char *)p;
+	size_t i;
+
+	for (i=0; i<n; ++i) {
+		h ^= s[i];
+		h *= 0x100000001b3UL;
+	}
+	return h;
+}
+
+uint64_t
+time_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+		EXIT("clock_gettime()");
+	}
+	return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
 void
 safe_sprintf(char *buf, size_t len, const char *format, ...)
 {
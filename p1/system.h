@@ -47,8 +47,23 @@
 		}				\
 	} while (0)
 
+#define HASH_INIT 0xcbf29ce484222325UL
+
 void file_delete(const char *pathname);
 
+/**
+ * Folds n bytes at p into the running 64-bit FNV-1a hash h. Start a new
+ * hash with h = HASH_INIT.
+ */
+
+uint64_t hash_update(uint64_t h, const void *p, size_t n);
+
+/**
+ * return: a monotonic timestamp in nanoseconds
+ */
+
+uint64_t time_ns(void);
+
 void safe_sprintf(char *buf, size_t len, const char *format, ...);
 
 size_t safe_strlen(const char *s);
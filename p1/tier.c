@@ -0,0 +1,236 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * tier.c
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "tier.h"
+#include "vm.h"
+
+/**
+ * Needs:
+ *   pthread_create()
+ *   pthread_join()
+ *   __atomic_load_n()
+ *   __atomic_store_n()
+ *   mkdtemp()
+ */
+
+typedef double (*evaluate_t)(const double *vars);
+
+/**
+ * Up to three tiers: the VM, the first module and, with profile-guided
+ * optimization, the module rebuilt from the first one's profile. Each
+ * module is published through fnc and stays loaded until tier_close(),
+ * since the caller may still be running the one it replaces.
+ */
+
+struct tier {
+	const struct parser *parser;
+	tier_build_t build;
+	evaluate_t fnc; /* published by a builder, NULL until then */
+	struct jitc *jitc;
+	struct jitc *hot; /* the profile-guided module */
+	int optimized;    /* BOOL: fnc is from hot */
+	pthread_t threads[2];
+	int started;      /* threads started */
+	uint64_t calls;   /* native calls so far */
+	uint64_t threshold;
+	char dir[64];     /* the profile directory, empty without PGO */
+	struct vm *vm;
+};
+
+static void
+options(const struct tier *tier, enum jitc_pgo pgo, struct jitc_options *o)
+{
+	memset(o, 0, sizeof (struct jitc_options));
+	o->opt = 3;
+	o->native = 1;
+	o->pgo = pgo;
+	o->pgo_dir = tier->dir;
+}
+
+static void *
+builder(void *arg)
+{
+	struct jitc_options o;
+	struct tier *tier;
+	evaluate_t fnc;
+
+	tier = (struct tier *)arg;
+	options(tier, tier->dir[0] ? JITC_PGO_GENERATE : JITC_PGO_NONE, &o);
+	if (!(tier->jitc = tier->build(tier->parser, &o)) ||
+	    !(fnc = (evaluate_t)jitc_lookup(tier->jitc, "evaluate"))) {
+		/* stay interpreted */
+		TRACE(0);
+		return NULL;
+	}
+	__atomic_store_n(&tier->fnc, fnc, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void *
+optimizer(void *arg)
+{
+	struct jitc_options o;
+	struct tier *tier;
+	evaluate_t fnc;
+
+	tier = (struct tier *)arg;
+	options(tier, JITC_PGO_USE, &o);
+	if (!(tier->hot = tier->build(tier->parser, &o)) ||
+	    !(fnc = (evaluate_t)jitc_lookup(tier->hot, "evaluate"))) {
+		/* stay instrumented */
+		TRACE(0);
+		return NULL;
+	}
+	__atomic_store_n(&tier->optimized, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&tier->fnc, fnc, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/**
+ * Called on the caller's thread once the instrumented module is hot: no
+ * evaluation is in flight, so the counters are dumped consistently.
+ */
+
+static void
+promote(struct tier *tier)
+{
+	if (!tier->dir[0] || jitc_profile_dump(tier->jitc)) {
+		return;
+	}
+	if (pthread_create(&tier->threads[tier->started],
+			   NULL,
+			   optimizer,
+			   tier)) {
+		TRACE("pthread_create()");
+		return;
+	}
+	++tier->started;
+}
+
+static void
+remove_dir(const char *path)
+{
+	char name[320];
+	struct dirent *dirent;
+	DIR *dir;
+
+	if ((dir = opendir(path))) {
+		while ((dirent = readdir(dir))) {
+			if (strcmp(dirent->d_name, ".") &&
+			    strcmp(dirent->d_name, "..")) {
+				safe_sprintf(name,
+					     sizeof (name),
+					     "%s/%s",
+					     path,
+					     dirent->d_name);
+				unlink(name);
+			}
+		}
+		closedir(dir);
+	}
+	rmdir(path);
+}
+
+struct tier *
+tier_open(const struct parser *parser,
+	  tier_build_t build,
+	  double (*final)(double),
+	  uint64_t hot)
+{
+	struct tier *tier;
+
+	assert( parser && build && final );
+
+	if (!(tier = malloc(sizeof (struct tier)))) {
+		TRACE("out of memory");
+		return NULL;
+	}
+	memset(tier, 0, sizeof (struct tier));
+	tier->parser = parser;
+	tier->build = build;
+	tier->threshold = hot;
+	if (hot) {
+		safe_sprintf(tier->dir,
+			     sizeof (tier->dir),
+			     "/tmp/cs238-pgo-XXXXXX");
+		if (!mkdtemp(tier->dir)) {
+			/* not fatal, no profile-guided module */
+			tier->dir[0] = '\0';
+		}
+	}
+	if (!(tier->vm = vm_open(parser, final))) {
+		tier_close(tier);
+		TRACE(0);
+		return NULL;
+	}
+	if (pthread_create(&tier->threads[0], NULL, builder, tier)) {
+		tier_close(tier);
+		TRACE("pthread_create()");
+		return NULL;
+	}
+	tier->started = 1;
+	return tier;
+}
+
+void
+tier_close(struct tier *tier)
+{
+	int i;
+
+	if (tier) {
+		for (i=0; i<tier->started; ++i) {
+			pthread_join(tier->threads[i], NULL);
+		}
+		jitc_close(tier->hot);
+		jitc_close(tier->jitc); /* may write its profile once more */
+		vm_close(tier->vm);
+		if (tier->dir[0]) {
+			remove_dir(tier->dir);
+		}
+		memset(tier, 0, sizeof (struct tier));
+	}
+	FREE(tier);
+}
+
+double
+tier_evaluate(struct tier *tier, const double *vars)
+{
+	evaluate_t fnc;
+
+	assert( tier );
+
+	if ((fnc = __atomic_load_n(&tier->fnc, __ATOMIC_ACQUIRE))) {
+		if (tier->threshold && (++tier->calls == tier->threshold)) {
+			promote(tier);
+		}
+		return fnc(vars);
+	}
+	return vm_evaluate(tier->vm, vars);
+}
+
+int
+tier_native(const struct tier *tier)
+{
+	assert( tier );
+
+	return NULL != __atomic_load_n(&tier->fnc, __ATOMIC_ACQUIRE);
+}
+
+int
+tier_optimized(const struct tier *tier)
+{
+	assert( tier );
+
+	return __atomic_load_n(&tier->optimized, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,79 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * tier.h
+ */
+
+#ifndef _TIER_H_
+#define _TIER_H_
+
+#include "jitc.h"
+
+/**
+ * tier_build_t produces the native module for an expression, e.g. by
+ * generating C and calling jitc_compile_memory() with options. It runs on
+ * a background thread and must only read the parser.
+ */
+
+typedef struct jitc *(*tier_build_t)(const struct parser *parser,
+				     const struct jitc_options *options);
+
+struct tier;
+
+/**
+ * Prepares an expression for tiered execution: it is interpreted right
+ * away by the bytecode VM (see vm_open()), while build runs on a
+ * background thread. Once the module is ready its evaluate() is swapped
+ * in and used by all later calls.
+ *
+ * With hot set, that first module is instrumented for profile-guided
+ * optimization. Once it has served hot calls, its profile is dumped and a
+ * second module is built in the background with -fprofile-use, to be
+ * swapped in the same way.
+ *
+ * parser: the parsed expression, must outlive the returned handle
+ * build : produces the native module
+ * final : applied to the value of the expression (as in the module)
+ * hot   : native calls before profile-guided recompilation (0: never)
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct tier *tier_open(const struct parser *parser,
+		       tier_build_t build,
+		       double (*final)(double),
+		       uint64_t hot);
+
+/**
+ * Waits for the background builds and releases all resources.
+ *
+ * Note: tier may be NULL
+ */
+
+void tier_close(struct tier *tier);
+
+/**
+ * Evaluates the expression, natively if the module is loaded, otherwise
+ * with the VM. Not to be called concurrently on one handle.
+ *
+ * vars: the variable values, indexed by symbol table index
+ */
+
+double tier_evaluate(struct tier *tier, const double *vars);
+
+/**
+ * return: true if tier_evaluate() runs native code
+ */
+
+int tier_native(const struct tier *tier);
+
+/**
+ * return: true if tier_evaluate() runs the profile-guided module
+ */
+
+int tier_optimized(const struct tier *tier);
+
+#endif /* _TIER_H_ */
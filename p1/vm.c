@@ -0,0 +1,310 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * vm.c
+ */
+
+#include <math.h>
+#include "vm.h"
+
+/**
+ * Three-address bytecode over a register file of doubles. Constants live
+ * in registers that are loaded once by vm_open(), so they cost nothing
+ * per evaluation. Every other node's register is recycled right after the
+ * node's last use, keeping the register file small and hot in cache.
+ *
+ * Dispatch is threaded through a table of label addresses (computed goto,
+ * a GNU extension), which gives every handler its own indirect branch
+ * instead of sharing the one at the top of a switch.
+ */
+
+enum vm_op {
+	VM_OP_LOAD, /* r[dst] = vars[a] */
+	VM_OP_NEG,  /* r[dst] = - r[b] */
+	VM_OP_MUL,  /* r[dst] = r[a] * r[b] */
+	VM_OP_DIV,  /* r[dst] = r[b] ? (r[a] / r[b]) : 0.0 */
+	VM_OP_ADD,  /* r[dst] = r[a] + r[b] */
+	VM_OP_SUB,  /* r[dst] = r[a] - r[b] */
+	VM_OP_EXP,  /* r[dst] = exp(r[b]) */
+	VM_OP_LOG,  /* r[dst] = log(r[b]) */
+	VM_OP_SQRT, /* r[dst] = sqrt(r[b]) */
+	VM_OP_ABS,  /* r[dst] = fabs(r[b]) */
+	VM_OP_SIGMOID, /* r[dst] = 1 / (1 + exp(- r[b])) */
+	VM_OP_POW,  /* r[dst] = pow(r[a], r[b]) */
+	VM_OP_MIN,  /* r[dst] = (r[a] < r[b]) ? r[a] : r[b] */
+	VM_OP_MAX,  /* r[dst] = (r[a] > r[b]) ? r[a] : r[b] */
+	VM_OP_RET   /* return final(r[a]) */
+};
+
+struct vm_insn {
+	uint32_t op;
+	uint32_t dst;
+	uint32_t a;
+	uint32_t b;
+};
+
+struct vm {
+	uint64_t size;
+	struct vm_insn *code;
+	uint32_t nregs;
+	double *regs;
+	double (*final)(double);
+};
+
+struct allocator {
+	uint32_t *reg;  /* node id -> register */
+	uint64_t *last; /* node id -> position of last use */
+	uint32_t *free; /* recycled registers */
+	uint32_t nfree;
+	uint32_t nregs;
+};
+
+static uint32_t
+allocate(struct allocator *allocator)
+{
+	if (allocator->nfree) {
+		return allocator->free[--allocator->nfree];
+	}
+	return allocator->nregs++;
+}
+
+static void
+release(struct allocator *allocator,
+	const struct parser_dag *dag,
+	uint64_t position)
+{
+	if (dag &&
+	    (PARSER_DAG_VAL != dag->op) &&
+	    (position == allocator->last[dag->id])) {
+		allocator->free[allocator->nfree++] = allocator->reg[dag->id];
+		allocator->last[dag->id] = 0; /* x * x releases once */
+	}
+}
+
+static int
+translate(struct vm *vm, const struct parser *parser)
+{
+	const struct parser_dag *dag, **nodes;
+	struct allocator allocator;
+	struct vm_insn *insn;
+	double *regs;
+	uint64_t k, n, m;
+
+	n = parser_size(parser);
+	memset(&allocator, 0, sizeof (struct allocator));
+	nodes = malloc((n + 1) * sizeof (nodes[0]));
+	allocator.reg = malloc((n + 1) * sizeof (allocator.reg[0]));
+	allocator.last = malloc((n + 1) * sizeof (allocator.last[0]));
+	allocator.free = malloc((n + 1) * sizeof (allocator.free[0]));
+	vm->code = malloc((n + 1) * sizeof (vm->code[0]));
+	regs = malloc((n + 1) * sizeof (regs[0]));
+	if (!nodes ||
+	    !allocator.reg ||
+	    !allocator.last ||
+	    !allocator.free ||
+	    !vm->code ||
+	    !regs) {
+		FREE(nodes);
+		FREE(allocator.reg);
+		FREE(allocator.last);
+		FREE(allocator.free);
+		FREE(regs);
+		TRACE("out of memory");
+		return -1;
+	}
+
+	/* reachable nodes, children first */
+
+	if (!(m = parser_order(parser, nodes))) {
+		FREE(nodes);
+		FREE(allocator.reg);
+		FREE(allocator.last);
+		FREE(allocator.free);
+		FREE(regs);
+		TRACE(0);
+		return -1;
+	}
+
+	/* last uses, positions are 1-based; the root is never released */
+
+	memset(allocator.last, 0, (n + 1) * sizeof (allocator.last[0]));
+	for (k=0; k<m; ++k) {
+		if (nodes[k]->left) {
+			allocator.last[nodes[k]->left->id] = k + 1;
+		}
+		if (nodes[k]->right) {
+			allocator.last[nodes[k]->right->id] = k + 1;
+		}
+	}
+	allocator.last[parser_dag(parser)->id] = m + 1;
+
+	/* instructions */
+
+	for (k=0; k<m; ++k) {
+		dag = nodes[k];
+		if (PARSER_DAG_VAL == dag->op) {
+			allocator.reg[dag->id] = allocator.nregs++;
+			regs[allocator.reg[dag->id]] = dag->val;
+			continue;
+		}
+		insn = &vm->code[vm->size++];
+		memset(insn, 0, sizeof (struct vm_insn));
+		if (dag->left) {
+			insn->a = allocator.reg[dag->left->id];
+		}
+		if (dag->right) {
+			insn->b = allocator.reg[dag->right->id];
+		}
+		release(&allocator, dag->left, k + 1);
+		release(&allocator, dag->right, k + 1);
+		insn->dst = allocator.reg[dag->id] = allocate(&allocator);
+		switch (dag->op) {
+		case PARSER_DAG_VAR:
+			insn->op = VM_OP_LOAD;
+			insn->a = (uint32_t)dag->var;
+			break;
+		case PARSER_DAG_NEG: insn->op = VM_OP_NEG; break;
+		case PARSER_DAG_MUL: insn->op = VM_OP_MUL; break;
+		case PARSER_DAG_DIV: insn->op = VM_OP_DIV; break;
+		case PARSER_DAG_ADD: insn->op = VM_OP_ADD; break;
+		case PARSER_DAG_SUB: insn->op = VM_OP_SUB; break;
+		case PARSER_DAG_EXP: insn->op = VM_OP_EXP; break;
+		case PARSER_DAG_LOG: insn->op = VM_OP_LOG; break;
+		case PARSER_DAG_SQRT: insn->op = VM_OP_SQRT; break;
+		case PARSER_DAG_ABS: insn->op = VM_OP_ABS; break;
+		case PARSER_DAG_SIGMOID: insn->op = VM_OP_SIGMOID; break;
+		case PARSER_DAG_POW: insn->op = VM_OP_POW; break;
+		case PARSER_DAG_MIN: insn->op = VM_OP_MIN; break;
+		case PARSER_DAG_MAX: insn->op = VM_OP_MAX; break;
+		default:
+			EXIT("software");
+		}
+	}
+	insn = &vm->code[vm->size++];
+	memset(insn, 0, sizeof (struct vm_insn));
+	insn->op = VM_OP_RET;
+	insn->a = allocator.reg[parser_dag(parser)->id];
+
+	vm->nregs = allocator.nregs;
+	vm->regs = regs;
+	FREE(nodes);
+	FREE(allocator.reg);
+	FREE(allocator.last);
+	FREE(allocator.free);
+	return 0;
+}
+
+struct vm *
+vm_open(const struct parser *parser, double (*final)(double))
+{
+	struct vm *vm;
+
+	assert( parser && final );
+
+	if (!(vm = malloc(sizeof (struct vm)))) {
+		TRACE("out of memory");
+		return NULL;
+	}
+	memset(vm, 0, sizeof (struct vm));
+	vm->final = final;
+	if (translate(vm, parser)) {
+		vm_close(vm);
+		TRACE(0);
+		return NULL;
+	}
+	return vm;
+}
+
+void
+vm_close(struct vm *vm)
+{
+	if (vm) {
+		FREE(vm->code);
+		FREE(vm->regs);
+		memset(vm, 0, sizeof (struct vm));
+	}
+	FREE(vm);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+double
+vm_evaluate(struct vm *vm, const double *vars)
+{
+	static const void * const LABELS[] = {
+		&&load, &&neg, &&mul, &&div, &&add, &&sub,
+		&&exp_, &&log_, &&sqrt_, &&abs_, &&sigmoid_, &&pow_, &&min_, &&max_,
+		&&ret
+	};
+	const struct vm_insn *pc;
+	double *r;
+
+	assert( vm );
+
+	pc = vm->code;
+	r = vm->regs;
+
+#define NEXT() goto *LABELS[(++pc)->op]
+
+	goto *LABELS[pc->op];
+ load:
+	r[pc->dst] = vars[pc->a];
+	NEXT();
+ neg:
+	r[pc->dst] = - r[pc->b];
+	NEXT();
+ mul:
+	r[pc->dst] = r[pc->a] * r[pc->b];
+	NEXT();
+ div:
+	r[pc->dst] = r[pc->b] ? (r[pc->a] / r[pc->b]) : 0.0;
+	NEXT();
+ add:
+	r[pc->dst] = r[pc->a] + r[pc->b];
+	NEXT();
+ sub:
+	r[pc->dst] = r[pc->a] - r[pc->b];
+	NEXT();
+ exp_:
+	r[pc->dst] = exp(r[pc->b]);
+	NEXT();
+ log_:
+	r[pc->dst] = log(r[pc->b]);
+	NEXT();
+ sqrt_:
+	r[pc->dst] = sqrt(r[pc->b]);
+	NEXT();
+ abs_:
+	r[pc->dst] = fabs(r[pc->b]);
+	NEXT();
+ sigmoid_:
+	r[pc->dst] = 1.0 / (1.0 + exp(- r[pc->b]));
+	NEXT();
+ pow_:
+	r[pc->dst] = pow(r[pc->a], r[pc->b]);
+	NEXT();
+ min_:
+	r[pc->dst] = (r[pc->a] < r[pc->b]) ? r[pc->a] : r[pc->b];
+	NEXT();
+ max_:
+	r[pc->dst] = (r[pc->a] > r[pc->b]) ? r[pc->a] : r[pc->b];
+	NEXT();
+ ret:
+	return vm->final(r[pc->a]);
+
+#undef NEXT
+}
+
+#pragma GCC diagnostic pop
+
+uint64_t
+vm_size(const struct vm *vm)
+{
+	assert( vm );
+
+	return vm->size;
+}
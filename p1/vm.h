@@ -0,0 +1,50 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * vm.h
+ */
+
+#ifndef _VM_H_
+#define _VM_H_
+
+#include "parser.h"
+
+struct vm;
+
+/**
+ * Compiles an expression into register-based bytecode. Needs neither gcc
+ * nor executable memory, and compiles in time linear in the DAG size.
+ *
+ * parser: the parsed expression, not referenced after this call
+ * final : applied to the value of the expression (as in the module)
+ *
+ * return: an opaque handle or NULL on error
+ */
+
+struct vm *vm_open(const struct parser *parser, double (*final)(double));
+
+/**
+ * Note: vm may be NULL
+ */
+
+void vm_close(struct vm *vm);
+
+/**
+ * Evaluates the expression. Not to be called concurrently on one handle,
+ * the register file is part of it.
+ *
+ * vars: the variable values, indexed by symbol table index
+ */
+
+double vm_evaluate(struct vm *vm, const double *vars);
+
+/**
+ * return: the number of bytecode instructions executed per evaluation
+ */
+
+uint64_t vm_size(const struct vm *vm);
+
+#endif /* _VM_H_ */
@@ -0,0 +1,359 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * x64.c
+ */
+
+#include <math.h>
+#include "x64.h"
+
+/**
+ * Every node owns an 8-byte slot in the stack frame, [rbp - 8 * (k + 1)],
+ * and is computed in the order of parser_order(), operands first:
+ * operands are loaded into xmm0/xmm1, the operation is applied and xmm0
+ * is stored back into the node's slot. The register usage is trivial, but
+ * compiling is a single linear pass.
+ * exp(), log() and pow() are called in libm; since rdi (vars) does not
+ * survive a call, an expression with calls spills it to slot 0.
+ *
+ *   push rbp
+ *   mov  rbp, rsp
+ *   sub  rsp, frame            ; frame keeps rsp 16-byte aligned
+ *   ...                        ; one block per node
+ *   movsd xmm0, [slot(root)]
+ *   mov  rax, final
+ *   call rax
+ *   leave
+ *   ret
+ */
+
+#define XMM0 0
+#define XMM1 1
+#define XMM2 2
+
+struct x64 {
+	size_t size;
+	size_t capacity;
+	uint8_t *code;
+	int *slots; /* node id -> slot, or -1 */
+	int n;      /* slots in use */
+	int vars;   /* BOOL: vars is spilled to slot 0 */
+	int stop;
+};
+
+static void
+emit(struct x64 *x64, const void *buf, size_t n)
+{
+	uint8_t *code;
+	size_t m;
+
+	if (x64->stop) {
+		return;
+	}
+	if ((x64->size + n) > x64->capacity) {
+		m = x64->capacity ? (2 * x64->capacity) : 256;
+		while (m < (x64->size + n)) {
+			m *= 2;
+		}
+		if (!(code = realloc(x64->code, m))) {
+			TRACE("out of memory");
+			x64->stop = 1;
+			return;
+		}
+		x64->code = code;
+		x64->capacity = m;
+	}
+	memcpy(x64->code + x64->size, buf, n);
+	x64->size += n;
+}
+
+static void
+emit_u8(struct x64 *x64, int a)
+{
+	uint8_t b = (uint8_t)a;
+
+	emit(x64, &b, 1);
+}
+
+static void
+emit_u32(struct x64 *x64, uint32_t v)
+{
+	uint8_t b[4];
+	int i;
+
+	for (i=0; i<4; ++i) {
+		b[i] = (uint8_t)(v >> (8 * i));
+	}
+	emit(x64, b, sizeof (b));
+}
+
+static void
+emit_u64(struct x64 *x64, uint64_t v)
+{
+	emit_u32(x64, (uint32_t)v);
+	emit_u32(x64, (uint32_t)(v >> 32));
+}
+
+static uint32_t
+disp(int slot)
+{
+	return (uint32_t)(-8 * (slot + 1));
+}
+
+/* movsd xmm, [rbp + disp32] */
+
+static void
+load(struct x64 *x64, int xmm, int slot)
+{
+	emit(x64, "\xf2\x0f\x10", 3);
+	emit_u8(x64, 0x85 | (xmm << 3));
+	emit_u32(x64, disp(slot));
+}
+
+/* movsd [rbp + disp32], xmm0 */
+
+static void
+store(struct x64 *x64, int slot)
+{
+	emit(x64, "\xf2\x0f\x11\x85", 4);
+	emit_u32(x64, disp(slot));
+}
+
+/* mov rax, imm64; movq xmm, rax */
+
+static void
+load_imm(struct x64 *x64, int xmm, uint64_t imm)
+{
+	emit(x64, "\x48\xb8", 2);
+	emit_u64(x64, imm);
+	emit(x64, "\x66\x48\x0f\x6e", 4);
+	emit_u8(x64, 0xc0 | (xmm << 3));
+}
+
+/* mov rax, fnc; call rax; mov rdi, [slot 0] */
+
+static void
+call(struct x64 *x64, uint64_t fnc)
+{
+	assert( x64->vars );
+
+	emit(x64, "\x48\xb8", 2);
+	emit_u64(x64, fnc);
+	emit(x64, "\xff\xd0", 2);
+	emit(x64, "\x48\x8b\xbd", 3);
+	emit_u32(x64, disp(0));
+}
+
+static int /* BOOL */
+calls(enum parser_dag_op op)
+{
+	return (PARSER_DAG_EXP == op) ||
+		(PARSER_DAG_LOG == op) ||
+		(PARSER_DAG_SIGMOID == op) ||
+		(PARSER_DAG_POW == op);
+}
+
+static int
+slot(struct x64 *x64, const struct parser_dag *dag)
+{
+	assert( 0 <= x64->slots[dag->id] );
+
+	return x64->slots[dag->id];
+}
+
+static void
+reflect(struct x64 *x64, const struct parser_dag *dag)
+{
+	const double ONE = 1.0;
+	uint64_t imm;
+
+	if (PARSER_DAG_VAL == dag->op) {
+		memcpy(&imm, &dag->val, sizeof (imm));
+		load_imm(x64, XMM0, imm);
+	}
+	else if (PARSER_DAG_VAR == dag->op) {
+		/* movsd xmm0, [rdi + disp32] */
+		emit(x64, "\xf2\x0f\x10\x87", 4);
+		emit_u32(x64, (uint32_t)(8 * dag->var));
+	}
+	else if (PARSER_DAG_NEG == dag->op) {
+		load(x64, XMM0, slot(x64, dag->right));
+		load_imm(x64, XMM1, (uint64_t)1 << 63);
+		emit(x64, "\x66\x0f\x57\xc1", 4); /* xorpd xmm0, xmm1 */
+	}
+	else if (!dag->left) {
+		load(x64, XMM0, slot(x64, dag->right));
+		if (PARSER_DAG_EXP == dag->op) {
+			call(x64, (uint64_t)(size_t)exp);
+		}
+		else if (PARSER_DAG_LOG == dag->op) {
+			call(x64, (uint64_t)(size_t)log);
+		}
+		else if (PARSER_DAG_SQRT == dag->op) {
+			emit(x64, "\xf2\x0f\x51\xc0", 4); /* sqrtsd xmm0, xmm0 */
+		}
+		else if (PARSER_DAG_ABS == dag->op) {
+			load_imm(x64, XMM1, ~((uint64_t)1 << 63));
+			emit(x64, "\x66\x0f\x54\xc1", 4); /* andpd xmm0, xmm1 */
+		}
+		else if (PARSER_DAG_SIGMOID == dag->op) {
+			/* 1 / (1 + exp(- x)) */
+			load_imm(x64, XMM1, (uint64_t)1 << 63);
+			emit(x64, "\x66\x0f\x57\xc1", 4); /* xorpd xmm0, xmm1 */
+			call(x64, (uint64_t)(size_t)exp);
+			emit(x64, "\x66\x0f\x28\xc8", 4); /* movapd xmm1, xmm0 */
+			memcpy(&imm, &ONE, sizeof (imm));
+			load_imm(x64, XMM0, imm);
+			emit(x64, "\xf2\x0f\x58\xc8", 4); /* addsd xmm1, xmm0 */
+			emit(x64, "\xf2\x0f\x5e\xc1", 4); /* divsd xmm0, xmm1 */
+		}
+		else {
+			EXIT("software");
+		}
+	}
+	else {
+		load(x64, XMM0, slot(x64, dag->left));
+		load(x64, XMM1, slot(x64, dag->right));
+		if (PARSER_DAG_MUL == dag->op) {
+			emit(x64, "\xf2\x0f\x59\xc1", 4); /* mulsd xmm0, xmm1 */
+		}
+		else if (PARSER_DAG_DIV == dag->op) {
+			/* branch-free right ? (left / right) : 0.0 */
+			emit(x64, "\x66\x0f\x57\xd2", 4); /* xorpd xmm2, xmm2 */
+			emit(x64, "\xf2\x0f\xc2\xd1\x04", 5); /* cmpneqsd xmm2, xmm1 */
+			emit(x64, "\xf2\x0f\x5e\xc1", 4); /* divsd xmm0, xmm1 */
+			emit(x64, "\x66\x0f\x54\xc2", 4); /* andpd xmm0, xmm2 */
+		}
+		else if (PARSER_DAG_ADD == dag->op) {
+			emit(x64, "\xf2\x0f\x58\xc1", 4); /* addsd xmm0, xmm1 */
+		}
+		else if (PARSER_DAG_SUB == dag->op) {
+			emit(x64, "\xf2\x0f\x5c\xc1", 4); /* subsd xmm0, xmm1 */
+		}
+		else if (PARSER_DAG_POW == dag->op) {
+			call(x64, (uint64_t)(size_t)pow);
+		}
+		else if (PARSER_DAG_MIN == dag->op) {
+			emit(x64, "\xf2\x0f\x5d\xc1", 4); /* minsd xmm0, xmm1 */
+		}
+		else if (PARSER_DAG_MAX == dag->op) {
+			emit(x64, "\xf2\x0f\x5f\xc1", 4); /* maxsd xmm0, xmm1 */
+		}
+		else {
+			EXIT("software");
+		}
+	}
+	x64->slots[dag->id] = x64->n++;
+	store(x64, slot(x64, dag));
+}
+
+struct x64 *
+x64_open(const struct parser *parser, x64_final_t final)
+{
+	const struct parser_dag *dag, **nodes;
+	size_t frame, patch;
+	struct x64 *x64;
+	uint64_t k, m;
+	int i, n;
+
+	assert( parser && final );
+
+	if (X64_MAX_NODES < parser_size(parser)) {
+		TRACE("expression too large");
+		return NULL;
+	}
+	if (!(x64 = malloc(sizeof (struct x64)))) {
+		TRACE("out of memory");
+		return NULL;
+	}
+	memset(x64, 0, sizeof (struct x64));
+	dag = parser_dag(parser);
+	n = (int)parser_size(parser) + 1;
+	if (!(x64->slots = malloc(n * sizeof (x64->slots[0])))) {
+		x64_close(x64);
+		TRACE("out of memory");
+		return NULL;
+	}
+	for (i=0; i<n; ++i) {
+		x64->slots[i] = -1;
+	}
+
+	if (!(nodes = malloc(parser_size(parser) * sizeof (nodes[0]))) ||
+	    !(m = parser_order(parser, nodes))) {
+		FREE(nodes);
+		x64_close(x64);
+		TRACE(0);
+		return NULL;
+	}
+
+	/* prologue, the frame size is patched in once known */
+
+	emit(x64, "\x55", 1);             /* push rbp */
+	emit(x64, "\x48\x89\xe5", 3);     /* mov rbp, rsp */
+	emit(x64, "\x48\x81\xec", 3);     /* sub rsp, imm32 */
+	patch = x64->size;
+	emit_u32(x64, 0);
+	for (k=0; (k<m) && !x64->vars; ++k) {
+		x64->vars = calls(nodes[k]->op);
+	}
+	if (x64->vars) {
+		emit(x64, "\x48\x89\xbd", 3); /* mov [rbp + disp32], rdi */
+		emit_u32(x64, disp(x64->n++));
+	}
+
+	/* body */
+
+	for (k=0; k<m; ++k) {
+		reflect(x64, nodes[k]);
+	}
+	FREE(nodes);
+
+	/* epilogue */
+
+	load(x64, XMM0, slot(x64, dag));
+	emit(x64, "\x48\xb8", 2);         /* mov rax, final */
+	emit_u64(x64, (uint64_t)(size_t)final);
+	emit(x64, "\xff\xd0", 2);         /* call rax */
+	emit(x64, "\xc9", 1);             /* leave */
+	emit(x64, "\xc3", 1);             /* ret */
+	if (x64->stop) {
+		x64_close(x64);
+		TRACE(0);
+		return NULL;
+	}
+	frame = ((8 * (size_t)x64->n) + 15) & ~(size_t)15;
+	for (i=0; i<4; ++i) {
+		x64->code[patch + i] = (uint8_t)(frame >> (8 * i));
+	}
+	return x64;
+}
+
+void
+x64_close(struct x64 *x64)
+{
+	if (x64) {
+		FREE(x64->code);
+		FREE(x64->slots);
+		memset(x64, 0, sizeof (struct x64));
+	}
+	FREE(x64);
+}
+
+size_t
+x64_size(const struct x64 *x64)
+{
+	assert( x64 );
+
+	return x64->size;
+}
+
+const void *
+x64_code(const struct x64 *x64)
+{
+	assert( x64 );
+
+	return x64->code;
+}
@@ -0,0 +1,69 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * x64.h
+ */
+
+#ifndef _X64_H_
+#define _X64_H_
+
+#include "parser.h"
+
+/**
+ * x64_final_t is applied to the value of the expression before it is
+ * returned, e.g. sigmoid().
+ */
+
+typedef double (*x64_final_t)(double x);
+
+/**
+ * The largest expression x64_open() takes, in nodes. The code keeps every
+ * node in its stack frame, 8 bytes each, and allocates the frame at once
+ * without probing it: a larger frame could reach past the guard page of
+ * the stack.
+ */
+
+#define X64_MAX_NODES 65536
+
+struct x64;
+
+/**
+ * Translates an expression into position-independent x86-64 (SSE2,
+ * System V ABI) machine code for
+ *
+ *   double evaluate(const double *vars)
+ *
+ * that matches the C emitted by generate(). The code is not executable
+ * until copied into an executable mapping (see jitc_emit()).
+ *
+ * parser: the parsed expression
+ * final : applied to the value of the expression before returning it
+ *
+ * return: an opaque handle or NULL on error, e.g. more than X64_MAX_NODES
+ *         nodes
+ */
+
+struct x64 *x64_open(const struct parser *parser, x64_final_t final);
+
+/**
+ * Note: x64 may be NULL
+ */
+
+void x64_close(struct x64 *x64);
+
+/**
+ * return: the size of the machine code in bytes
+ */
+
+size_t x64_size(const struct x64 *x64);
+
+/**
+ * return: the first byte of the machine code
+ */
+
+const void *x64_code(const struct x64 *x64);
+
+#endif /* _X64_H_ */
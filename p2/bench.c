@@ -0,0 +1,467 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * bench.c
+ */
+
+#undef _FORTIFY_SOURCE /* longjmp() onto another stack, see jumps() */
+
+#include <setjmp.h>
+#include "system.h"
+#include "context.h"
+#include "scheduler.h"
+
+/**
+ * Context switch latency, one CSV line per benchmark with the percentiles
+ * of SAMPLES runs, in nanoseconds per switch. Built and run by "make
+ * bench".
+ *
+ * yield: two user threads ping-pong through scheduler_yield(), ROUNDS
+ * times each, every yield is one switch. Thread creation is not timed.
+ *
+ * swap: swap_context() alone between two bare contexts, the floor under
+ * the scheduler's bookkeeping. Both sides switch from the same call site,
+ * as two threads in scheduler_yield() do, so that every return lands
+ * where the return stack buffer predicts it.
+ *
+ * longjmp: the switch swap_context() replaced, as a baseline. Two bare
+ * contexts ping-pong the way the setjmp/longjmp scheduler did, each
+ * switch a setjmp()/longjmp() into the scheduler and another one out.
+ *
+ * spawn: one user thread creates an empty task and yields to it, TASKS
+ * times, in nanoseconds per task: create, start, exit and reclaim, with
+ * one task alive at a time.
+ *
+ * batch: the same TASKS tasks created up front, then run by a single
+ * scheduler_execute(), all of them alive at once. More tasks than the
+ * default stack cache holds, so most stacks are mapped afresh every time;
+ * batch-cached raises the cap to TASKS.
+ *
+ * parallel: PARALLEL user threads each compute CHUNKS chunks of floating
+ * point work, yielding in between, in nanoseconds of wall time per chunk.
+ * It scales with the workers (SCHEDULER_WORKERS, one per CPU by default),
+ * the other benchmarks mostly measure their overhead.
+ *
+ * stall: one user thread creates CHILDREN empty tasks, queued behind it on
+ * its worker, then computes without ever yielding until they have all run,
+ * in microseconds. Only other workers can run them, taking them from under
+ * the busy one; with a single worker the parent gives up after STALL.
+ *
+ * scale: yield again, across 10, 100, ... up to SCALE user threads, or
+ * the limit given as the only argument ("make bench BENCHFLAGS=1000000"),
+ * in nanoseconds per switch. Every thread touches at least a page of
+ * stack: 10k threads hold 40 MiB resident, 1M threads 4 GiB, so 1M is
+ * opt-in. The stacks have no guard, before Linux 6.13 1M guarded stacks
+ * would need 2M mappings, and are cached between samples; creation is not
+ * timed.
+ */
+
+#define SAMPLES 31
+#define ROUNDS 100000
+#define STACK 65536
+#define TASKS 10000
+#define PARALLEL 64
+#define CHUNKS 16
+#define WORK 10000 /* dependent multiply-adds per chunk */
+#define CHILDREN 16
+#define STALL 100000000 /* nanoseconds */
+#define SCALE 10000 /* threads, see scale() */
+#define SWITCHES 1000000 /* per sample, at least */
+
+static volatile double sinks[PARALLEL]; /* keep the work from being optimized away */
+
+static int done;         /* children run, atomic, see stall() */
+static uint64_t stalled; /* nanoseconds */
+
+static int yields; /* per thread, see scale() */
+
+static struct context caller, ping, pong;
+static struct context *next;   /* the context rally() starts as */
+static struct context *resume; /* the context that switched to caller */
+static long remaining;         /* switches left in this sample */
+
+static jmp_buf hub, jumpers[2]; /* the scheduler and its two threads */
+static int turn;                /* the jumper running */
+
+static int
+compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t
+percentile(const uint64_t *samples, int n, int p)
+{
+	return samples[((n - 1) * p + 50) / 100];
+}
+
+/**
+ * Prints one result line. samples are sorted in place.
+ */
+
+static void
+report(const char *benchmark,
+       int threads,
+       const char *unit,
+       uint64_t *samples,
+       int n)
+{
+	qsort(samples, n, sizeof (samples[0]), compare);
+	printf("%s,%d,%s,%d,%lu,%lu,%lu,%lu,%lu\n",
+	       benchmark,
+	       threads,
+	       unit,
+	       n,
+	       (unsigned long)samples[0],
+	       (unsigned long)percentile(samples, n, 50),
+	       (unsigned long)percentile(samples, n, 90),
+	       (unsigned long)percentile(samples, n, 99),
+	       (unsigned long)samples[n - 1]);
+	fflush(stdout);
+}
+
+static void
+_pingpong_(void *arg)
+{
+	int i;
+
+	UNUSED(arg);
+	for (i=0; i<ROUNDS; ++i) {
+		scheduler_yield();
+	}
+}
+
+static int
+yield(void)
+{
+	uint64_t samples[SAMPLES], t;
+	int i;
+
+	for (i=0; i<SAMPLES; ++i) {
+		if (scheduler_create(_pingpong_, NULL) ||
+		    scheduler_create(_pingpong_, NULL)) {
+			TRACE(0);
+			return -1;
+		}
+		t = time_ns();
+		scheduler_execute();
+		samples[i] = (time_ns() - t) / (2 * ROUNDS);
+	}
+	report("yield", 2, "ns/switch", samples, SAMPLES);
+	return 0;
+}
+
+static void
+rally(void)
+{
+	struct context *self, *other;
+
+	self = next;
+	other = (&ping == self) ? &pong : &ping;
+	next = other;
+	for (;;) {
+		resume = self;
+		swap_context(self, (0 < remaining--) ? other : &caller);
+	}
+}
+
+static int
+swap(void)
+{
+	uint64_t samples[SAMPLES], t;
+	char *stack;
+	int i;
+
+	if (!(stack = malloc(2 * STACK))) {
+		TRACE("out of memory");
+		return -1;
+	}
+	context_init(&ping, stack, STACK, rally);
+	context_init(&pong, stack + STACK, STACK, rally);
+	next = resume = &ping;
+	for (i=0; i<SAMPLES; ++i) {
+		remaining = 2 * ROUNDS;
+		t = time_ns();
+		swap_context(&caller, resume);
+		samples[i] = (time_ns() - t) / (2 * ROUNDS);
+	}
+	FREE(stack);
+	report("swap", 2, "ns/switch", samples, SAMPLES);
+	return 0;
+}
+
+static void
+jumper(void)
+{
+	const int me = turn;
+
+	for (;;) {
+		if (!setjmp(jumpers[me])) {
+			longjmp(hub, 1);
+		}
+	}
+}
+
+/**
+ * The old scheduler loop: every switch lands in hub and jumps on to the
+ * other jumper, until remaining runs out.
+ */
+
+static void
+dispatch(void)
+{
+	setjmp(hub);
+	if (0 < remaining--) {
+		turn = !turn;
+		longjmp(jumpers[turn], 1);
+	}
+}
+
+static int
+jumps(void)
+{
+	uint64_t samples[SAMPLES], t;
+	char *stack;
+	int i;
+
+	if (!(stack = malloc(2 * STACK))) {
+		TRACE("out of memory");
+		return -1;
+	}
+
+	/* each jumper runs up to its first setjmp() on a stack of its own */
+
+	context_init(&ping, stack, STACK, jumper);
+	context_init(&pong, stack + STACK, STACK, jumper);
+	for (turn=0; turn<2; ++turn) {
+		if (!setjmp(hub)) {
+			swap_context(&caller, turn ? &pong : &ping);
+		}
+	}
+	turn = 0;
+	for (i=0; i<SAMPLES; ++i) {
+		remaining = 2 * ROUNDS;
+		t = time_ns();
+		dispatch();
+		samples[i] = (time_ns() - t) / (2 * ROUNDS);
+	}
+	FREE(stack);
+	report("longjmp", 2, "ns/switch", samples, SAMPLES);
+	return 0;
+}
+
+static void
+_task_(void *arg)
+{
+	UNUSED(arg);
+}
+
+static void
+_spawner_(void *arg)
+{
+	int i;
+
+	UNUSED(arg);
+	for (i=0; i<TASKS; ++i) {
+		if (scheduler_create(_task_, NULL)) {
+			EXIT("scheduler_create()");
+		}
+		scheduler_yield();
+	}
+}
+
+static int
+spawn(void)
+{
+	uint64_t samples[SAMPLES], t;
+	int i;
+
+	for (i=0; i<SAMPLES; ++i) {
+		if (scheduler_create(_spawner_, NULL)) {
+			TRACE(0);
+			return -1;
+		}
+		t = time_ns();
+		scheduler_execute();
+		samples[i] = (time_ns() - t) / TASKS;
+	}
+	report("spawn", 2, "ns/task", samples, SAMPLES);
+	return 0;
+}
+
+static int
+batch(const char *benchmark, size_t cache)
+{
+	uint64_t samples[SAMPLES], t;
+	int i, j;
+
+	scheduler_stack_cache(cache);
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		for (j=0; j<TASKS; ++j) {
+			if (scheduler_create(_task_, NULL)) {
+				TRACE(0);
+				return -1;
+			}
+		}
+		scheduler_execute();
+		samples[i] = (time_ns() - t) / TASKS;
+	}
+	scheduler_stack_cache(SCHEDULER_STACK_CACHE);
+	report(benchmark, TASKS, "ns/task", samples, SAMPLES);
+	return 0;
+}
+
+static void
+_compute_(void *arg)
+{
+	double x;
+	int i, j;
+
+	x = (double)(size_t)arg;
+	for (i=0; i<CHUNKS; ++i) {
+		for (j=0; j<WORK; ++j) {
+			x = x * 0.999999 + 1e-6;
+		}
+		scheduler_yield();
+	}
+	sinks[(size_t)arg] = x;
+}
+
+static int
+parallel(void)
+{
+	uint64_t samples[SAMPLES], t;
+	size_t j;
+	int i;
+
+	for (i=0; i<SAMPLES; ++i) {
+		t = time_ns();
+		for (j=0; j<PARALLEL; ++j) {
+			if (scheduler_create(_compute_, (void *)j)) {
+				TRACE(0);
+				return -1;
+			}
+		}
+		scheduler_execute();
+		samples[i] = (time_ns() - t) / (PARALLEL * CHUNKS);
+	}
+	report("parallel", PARALLEL, "ns/chunk", samples, SAMPLES);
+	return 0;
+}
+
+static void
+_child_(void *arg)
+{
+	UNUSED(arg);
+	__atomic_add_fetch(&done, 1, __ATOMIC_RELEASE);
+}
+
+static void
+_parent_(void *arg)
+{
+	uint64_t t;
+	int i;
+
+	UNUSED(arg);
+	t = time_ns();
+	for (i=0; i<CHILDREN; ++i) {
+		if (scheduler_create(_child_, NULL)) {
+			EXIT("scheduler_create()");
+		}
+	}
+	while ((CHILDREN > __atomic_load_n(&done, __ATOMIC_ACQUIRE)) &&
+	       ((time_ns() - t) < STALL)) {
+	}
+	stalled = time_ns() - t;
+}
+
+static int
+stall(void)
+{
+	uint64_t samples[SAMPLES];
+	int i;
+
+	for (i=0; i<SAMPLES; ++i) {
+		done = 0;
+		if (scheduler_create(_parent_, NULL)) {
+			TRACE(0);
+			return -1;
+		}
+		scheduler_execute();
+		samples[i] = stalled / 1000;
+	}
+	report("stall", CHILDREN + 1, "us", samples, SAMPLES);
+	return 0;
+}
+
+static void
+_yielder_(void *arg)
+{
+	int i;
+
+	UNUSED(arg);
+	for (i=0; i<yields; ++i) {
+		scheduler_yield();
+	}
+}
+
+static int
+scale(long limit)
+{
+	struct scheduler_attr attr;
+	uint64_t samples[SAMPLES], t;
+	long threads, j;
+	int i, n;
+
+	scheduler_attr_init(&attr);
+	attr.guard_size = 0;
+	for (threads=10; threads<=limit; threads*=10) {
+		yields = (int)((SWITCHES / threads) ? (SWITCHES / threads) : 1);
+		yields = (4 > yields) ? 4 : yields;
+		n = (100000 <= threads) ? 3 : SAMPLES;
+		scheduler_stack_cache((size_t)threads);
+		for (i=0; i<n; ++i) {
+			for (j=0; j<threads; ++j) {
+				if (scheduler_create_attr(_yielder_, NULL, &attr)) {
+					TRACE(0);
+					return -1;
+				}
+			}
+			t = time_ns();
+			scheduler_execute();
+			samples[i] = (time_ns() - t) / ((uint64_t)threads * yields);
+		}
+		scheduler_stack_cache(SCHEDULER_STACK_CACHE);
+		report("scale", (int)threads, "ns/switch", samples, n);
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	long limit;
+
+	limit = (1 < argc) ? atol(argv[1]) : SCALE;
+	printf("benchmark,threads,unit,samples,min,p50,p90,p99,max\n");
+	if (yield() ||
+	    swap() ||
+	    jumps() ||
+	    spawn() ||
+	    batch("batch", SCHEDULER_STACK_CACHE) ||
+	    batch("batch-cached", TASKS) ||
+	    parallel() ||
+	    stall() ||
+	    scale(limit)) {
+		TRACE(0);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * context.c
+ */
+
+#include "context.h"
+
+/**
+ * A suspended stack, from its saved stack pointer up:
+ *
+ *   sp +  0  MXCSR (4 bytes), x87 control word (2 bytes), padding
+ *   sp +  8  r15
+ *   sp + 16  r14
+ *   sp + 24  r13
+ *   sp + 32  r12
+ *   sp + 40  rbx
+ *   sp + 48  rbp
+ *   sp + 56  return address
+ *
+ * swap_context() pushes that frame, stores rsp in from->sp, loads rsp
+ * from to->sp, pops the other frame and returns into it. Caller-saved
+ * registers need no saving, the call already told the compiler they are
+ * clobbered.
+ */
+
+#define FRAME 8 /* words */
+
+__asm__(".pushsection .text\n"
+	".globl swap_context\n"
+	".type swap_context, @function\n"
+	"swap_context:\n"
+	"\tpushq %rbp\n"
+	"\tpushq %rbx\n"
+	"\tpushq %r12\n"
+	"\tpushq %r13\n"
+	"\tpushq %r14\n"
+	"\tpushq %r15\n"
+	"\tsubq $8, %rsp\n"
+	"\tstmxcsr (%rsp)\n"
+	"\tfnstcw 4(%rsp)\n"
+	"\tmovq %rsp, (%rdi)\n"
+	"\tmovq (%rsi), %rsp\n"
+	"\tldmxcsr (%rsp)\n"
+	"\tfldcw 4(%rsp)\n"
+	"\taddq $8, %rsp\n"
+	"\tpopq %r15\n"
+	"\tpopq %r14\n"
+	"\tpopq %r13\n"
+	"\tpopq %r12\n"
+	"\tpopq %rbx\n"
+	"\tpopq %rbp\n"
+	"\tret\n"
+	".size swap_context, .-swap_context\n"
+	".popsection\n");
+
+void
+context_init(struct context *context,
+	     void *stack,
+	     size_t size,
+	     void (*entry)(void))
+{
+	uint64_t *sp;
+	uint32_t mxcsr;
+	uint16_t fpucw;
+
+	assert( context && stack && size && entry );
+
+	/*
+	 * Functions are entered with rsp + 8 aligned to 16, as after a call:
+	 * entry finds a zero return address at the top and pops into it from
+	 * a frame just below.
+	 */
+
+	sp = (uint64_t *)((uintptr_t)((char *)stack + size) & ~(uintptr_t)15);
+	sp -= FRAME + 1;
+	memset(sp, 0, (FRAME + 1) * sizeof (sp[0]));
+	__asm__ volatile ("stmxcsr %0" : "=m" (mxcsr));
+	__asm__ volatile ("fnstcw %0" : "=m" (fpucw));
+	memcpy((char *)sp, &mxcsr, sizeof (mxcsr));
+	memcpy((char *)sp + 4, &fpucw, sizeof (fpucw));
+	memcpy(&sp[FRAME - 1], &entry, sizeof (entry));
+	context->sp = sp;
+}
@@ -0,0 +1,49 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * context.h
+ */
+
+#ifndef _CONTEXT_H_
+#define _CONTEXT_H_
+
+#include "system.h"
+
+/**
+ * A suspended flow of execution, x86-64 System V only. Everything the
+ * ABI asks a callee to preserve (rbx, rbp, r12-r15, the MXCSR control
+ * bits and the x87 control word) is kept on the suspended stack itself,
+ * so the context is just that stack's pointer.
+ */
+
+struct context {
+	void *sp;
+};
+
+/**
+ * Prepares context to run entry on a fresh stack the first time it is
+ * switched to. entry must never return, it has to switch away for good
+ * instead. The control words are copied from the caller.
+ *
+ * stack: the lowest address of the stack
+ * size : the size of the stack in bytes
+ * entry: the function to start in
+ */
+
+void context_init(struct context *context,
+		  void *stack,
+		  size_t size,
+		  void (*entry)(void));
+
+/**
+ * Saves the caller's context in from and resumes to, returning when some
+ * later switch resumes from. Costs a handful of pushes and pops, no
+ * system calls and no signal mask.
+ */
+
+void swap_context(struct context *from, const struct context *to);
+
+#endif /* _CONTEXT_H_ */
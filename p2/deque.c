@@ -0,0 +1,183 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * deque.c
+ */
+
+#include "deque.h"
+
+/**
+ * Needs:
+ *   __atomic_load_n()
+ *   __atomic_store_n()
+ *   __atomic_compare_exchange_n()
+ *   __atomic_thread_fence()
+ *
+ * The orderings follow N. M. Le et al., "Correct and Efficient
+ * Work-Stealing for Weak Memory Models", PPoPP 2013, without pop: the
+ * owner steals too.
+ */
+
+#define SIZE 64 /* initial slots, a power of two */
+
+struct deque_ring {
+	long size;
+	struct deque_ring *next; /* retired rings */
+	void **slots;
+};
+
+static struct deque_ring *
+ring_open(long size)
+{
+	struct deque_ring *ring;
+
+	if (!(ring = malloc(sizeof (struct deque_ring) +
+			    size * sizeof (ring->slots[0])))) {
+		TRACE("out of memory");
+		return NULL;
+	}
+	ring->size = size;
+	ring->next = NULL;
+	ring->slots = (void **)(ring + 1);
+	return ring;
+}
+
+static void *
+load(const struct deque_ring *ring, long i)
+{
+	return __atomic_load_n(&ring->slots[i & (ring->size - 1)],
+			       __ATOMIC_RELAXED);
+}
+
+static void
+store(struct deque_ring *ring, long i, void *item)
+{
+	__atomic_store_n(&ring->slots[i & (ring->size - 1)],
+			 item,
+			 __ATOMIC_RELAXED);
+}
+
+/**
+ * Copies the live slots top..bottom-1 into a ring twice the size. Only
+ * the owner writes slots, so the copy is consistent; the old ring stays
+ * readable for thieves that loaded it before the switch.
+ */
+
+static struct deque_ring *
+grow(struct deque *deque, long top, long bottom)
+{
+	struct deque_ring *ring;
+	long i;
+
+	if (!(ring = ring_open(2 * deque->ring->size))) {
+		TRACE(0);
+		return NULL;
+	}
+	for (i=top; i<bottom; ++i) {
+		store(ring, i, load(deque->ring, i));
+	}
+	deque->ring->next = deque->retired;
+	deque->retired = deque->ring;
+	__atomic_store_n(&deque->ring, ring, __ATOMIC_RELEASE);
+	return ring;
+}
+
+int
+deque_init(struct deque *deque)
+{
+	assert( deque );
+
+	memset(deque, 0, sizeof (struct deque));
+	if (!(deque->ring = ring_open(SIZE))) {
+		TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+void
+deque_free(struct deque *deque)
+{
+	if (deque) {
+		deque_reclaim(deque);
+		FREE(deque->ring);
+		memset(deque, 0, sizeof (struct deque));
+	}
+}
+
+int
+deque_push(struct deque *deque, void *item)
+{
+	struct deque_ring *ring;
+	long top, bottom;
+
+	assert( deque && item );
+
+	bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+	top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	ring = __atomic_load_n(&deque->ring, __ATOMIC_RELAXED);
+	if ((bottom - top) >= ring->size) {
+		if (!(ring = grow(deque, top, bottom))) {
+			TRACE(0);
+			return -1;
+		}
+	}
+	store(ring, bottom, item);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+void *
+deque_steal(struct deque *deque)
+{
+	struct deque_ring *ring;
+	long top, bottom;
+	void *item;
+
+	assert( deque );
+
+	for (;;) {
+		top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+		if (top >= bottom) {
+			return NULL;
+		}
+		ring = __atomic_load_n(&deque->ring, __ATOMIC_ACQUIRE);
+		item = load(ring, top);
+		if (__atomic_compare_exchange_n(&deque->top,
+						&top,
+						top + 1,
+						0,
+						__ATOMIC_SEQ_CST,
+						__ATOMIC_RELAXED)) {
+			return item;
+		}
+	}
+}
+
+int
+deque_empty(const struct deque *deque)
+{
+	assert( deque );
+
+	return __atomic_load_n(&deque->top, __ATOMIC_RELAXED) >=
+		__atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+}
+
+void
+deque_reclaim(struct deque *deque)
+{
+	struct deque_ring *ring;
+
+	assert( deque );
+
+	while ((ring = deque->retired)) {
+		deque->retired = ring->next;
+		FREE(ring);
+	}
+}
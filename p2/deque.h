@@ -0,0 +1,79 @@
+/**
+ * Tony Givargis
+ * Copyright (C), 2023
+ * University of California, Irvine
+ *
+ * CS 238P - Operating Systems
+ * deque.h
+ */
+
+#ifndef _DEQUE_H_
+#define _DEQUE_H_
+
+#include "system.h"
+
+/**
+ * A Chase-Lev work-stealing deque of pointers: one owner thread pushes at
+ * the bottom, any thread, the owner included, steals at the top, so items
+ * come out in FIFO order. Lock-free, a steal costs one compare-and-swap.
+ * The buffer doubles when full; an outgrown buffer may still be read by a
+ * thief, so it is kept until deque_reclaim().
+ */
+
+struct deque_ring;
+
+struct deque {
+	long top;    /* next to steal, advanced by any thread */
+	char pad_[64 - sizeof (long)];
+	long bottom; /* next free slot, advanced by the owner */
+	struct deque_ring *ring;
+	struct deque_ring *retired;
+};
+
+/**
+ * return: 0 on success, otherwise error
+ */
+
+int deque_init(struct deque *deque);
+
+/**
+ * Note: no other thread may be using deque
+ */
+
+void deque_free(struct deque *deque);
+
+/**
+ * Owner only.
+ *
+ * return: 0 on success, otherwise error (out of memory, item not queued)
+ */
+
+int deque_push(struct deque *deque, void *item);
+
+/**
+ * Any thread. Retries a lost race, so NULL means the deque was seen empty.
+ *
+ * return: the oldest item or NULL
+ */
+
+void *deque_steal(struct deque *deque);
+
+/**
+ * Any thread. A hint only, without the ordering of deque_steal(): items
+ * may have come or gone by the time it returns. Exact for the owner as
+ * far as its own pushes go.
+ *
+ * return: true if the deque looked empty
+ */
+
+int deque_empty(const struct deque *deque);
+
+/**
+ * Frees the outgrown buffers.
+ *
+ * Note: no other thread may be using deque
+ */
+
+void deque_reclaim(struct deque *deque);
+
+#endif /* _DEQUE_H_ */
@@ -27,9 +27,9 @@ _thread_(void *arg)
 int
 main(int argc, char *argv[])
 {
-	UNUSED(argc);
-	UNUSED(argv);
+	int verbose;
 
+	verbose = (1 < argc) && !strcmp(argv[1], "-v");
 	if (scheduler_create(_thread_, "hello") ||
 	    scheduler_create(_thread_, "world") ||
 	    scheduler_create(_thread_, "love") ||
@@ -38,6 +38,12 @@ main(int argc, char *argv[])
 		TRACE(0);
 		return -1;
 	}
+	printf("Executing scheduler.\n");
 	scheduler_execute();
+	if (verbose) {
+		printf("stack: high-water mark %lu of %lu bytes\n",
+		       (unsigned long)scheduler_stack_high_water(),
+		       (unsigned long)SCHEDULER_STACK_SIZE);
+	}
 	return 0;
 }
@@ -7,26 +7,54 @@
  * scheduler.c
  */
 
-#undef _FORTIFY_SOURCE
+#define _GNU_SOURCE
 
 /**
  * Needs:
- *   setjmp()
- *   longjmp()
+ *   swap_context()
+ *   context_init()
+ *   mmap()
+ *   mprotect()
+ *   madvise()
+ *   munmap()
+ *   mincore()
+ *   pthread_create()
+ *   pthread_join()
+ *   sched_yield()
+ *   futex()
+ *   sysconf()
  */
 
-/* research the above Needed API and design accordingly */
+/* threads switch to each other directly, see context.h */
+/* M:N: user threads run on a set of kernel threads, the workers, see scheduler.h */
 
 #include <stdio.h>
-#include <unistd.h>
-#include <signal.h>
-#include <setjmp.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include "system.h"
+#include "context.h"
+#include "deque.h"
 #include "scheduler.h"
 
+#define MAX_WORKERS 256
+#define SPINS 100        /* sched_yield() rounds of an idle worker before it parks */
+#define PARK_NS 1000000L /* the longest a parked worker sleeps, see park() */
+
+#ifndef MADV_GUARD_INSTALL
+#define MADV_GUARD_INSTALL 102 /* Linux 6.13 */
+#endif
+
+struct worker;
+
 struct thread {
-    jmp_buf ctx;
+    struct context ctx;
     enum {
         STATUS_, /* initial status */
         STATUS_RUNNING,
@@ -36,68 +64,413 @@ struct thread {
     scheduler_fnc_t function; /* thread start function*/
     void *args;                /* argument for the start function*/
     struct {
-        void *memory_;
-        void *memory;
+        void *memory; /* the mapping, guard pages first */
+        size_t size;  /* of the mapping */
+        size_t guard; /* bytes of guard pages */
     } stack;
-    struct thread *link; 
+    struct worker *worker; /* running it, set on every resume */
+    struct thread *link;   /* creation order before scheduler_execute(), pool lists */
+};
+
+/* Terminated threads, kept for the next scheduler_create() on the same worker.*/
+struct pool {
+    struct thread *stacks;  /* still holding their stack, linked by link */
+    struct thread *threads; /* stack released */
+    size_t cached;          /* length of stacks */
+};
+
+struct worker {
+    struct {
+        struct thread *head; /* oldest, linked by link */
+        struct thread *tail;
+        long n;
+        int lock;           /* see lock() */
+    } ready;                /* ready threads, mostly private to this worker */
+    struct deque deque;     /* ready threads shared with idle workers, see share() */
+    struct context ctx;     /* the worker loop, resumed when no thread is ready */
+    struct thread *thread;  /* running, NULL in the worker loop */
+    struct thread *pending; /* just switched away from, queued or recycled once off its stack */
+    struct pool pool;
+    size_t high_water;      /* see scheduler_stack_high_water() */
+    unsigned long seed;     /* picks the workers to steal from */
+    unsigned long ticks;    /* scheduling decisions */
+    pthread_t pthread;
 };
 
 static struct {
-    struct thread *head;
-    struct thread *thread; /* current running thread */
-    jmp_buf ctx;
-} state;
-
-static void destroy(void) {
-    struct thread *current = state.head;
-    struct thread *start = state.head; 
-    /*printf("Entering destroy function.\n");*/
-    if (current) { 
-        do {
-            struct thread *next = current->link;
-            free(current->stack.memory_);
-            free(current);
-            current = next;
-        } while (current && current != start); 
-    }
-    state.head = NULL;
-    state.thread = NULL;
-    /*printf("All threads destroyed.\n");*/
-}
-
-static struct thread *thread_candidate(void) {
-    struct thread *current;
-    struct thread *start;
+    struct worker *workers;
+    int n;               /* workers */
+    long live;           /* threads created and not yet terminated, atomic */
+    int hungry;          /* workers with nothing to run, atomic */
+    int parked;          /* workers asleep in park(), atomic */
+    int epoch;           /* futex, bumped by notify(), atomic */
+    struct thread *head; /* created before scheduler_execute() */
+    struct thread *tail;
+    size_t cap;          /* see scheduler_stack_cache() */
+    int split;           /* guards need their own mapping, see protect_guard() */
+} state = { NULL, 0, 0, 0, 0, 0, NULL, NULL, SCHEDULER_STACK_CACHE, 0 };
 
-    /*printf("Looking for a thread candidate.\n");*/
-    if (!state.head) {
-        printf("No threads to run.\n");
-        return NULL;
+/* The worker of the calling kernel thread, NULL outside scheduler_execute(). A user
+   thread may come back on another worker after a switch, so this is read once on
+   entry and thread->worker after that. initial-exec: -fpic would otherwise make
+   every access a __tls_get_addr() call.*/
+static __thread struct worker *self __attribute__((tls_model("initial-exec")));
+
+/* Allocates the workers on first use: SCHEDULER_WORKERS of them, or one per CPU.*/
+static int setup(void) {
+    const char *s;
+    long n;
+    int i;
+
+    if (state.workers) {
+        return 0;
     }
+    n = (s = getenv("SCHEDULER_WORKERS")) ? atol(s) : sysconf(_SC_NPROCESSORS_ONLN);
+    n = (n < 1) ? 1 : (n > MAX_WORKERS) ? MAX_WORKERS : n;
+    state.workers = (struct worker *)calloc(n, sizeof(struct worker));
+    if (!state.workers) {
+        printf("Failed to allocate memory for workers.\n");
+        return -1;
+    }
+    for (i = 0; i < n; ++i) {
+        if (deque_init(&state.workers[i].deque)) {
+            printf("Failed to allocate memory for workers.\n");
+            while (i--) {
+                deque_free(&state.workers[i].deque);
+            }
+            free(state.workers);
+            state.workers = NULL;
+            return -1;
+        }
+        state.workers[i].seed = (unsigned long)i + 1;
+    }
+    state.n = (int)n;
+    return 0;
+}
 
-    /* Start from next thread or head if no current thread.*/
-    start = current = state.thread ? state.thread->link : state.head;
+/* Stack bytes ever touched: the stack grows down from the top of the mapping,
+   so everything from the lowest resident page up has been used.*/
+static size_t high_water(const struct thread *thread) {
+    size_t page = page_size();
+    size_t pages = (thread->stack.size - thread->stack.guard) / page;
+    char *stack = (char *)thread->stack.memory + thread->stack.guard;
+    unsigned char *vec = (unsigned char *)malloc(pages);
+    size_t i = pages;
 
-    do {
-         if (current->status != STATUS_TERMINATED && (current->status == STATUS_ || current->status == STATUS_SLEEPING)) {
-            /*printf("Thread candidate found.\n");*/
-            return current;
+    if (vec && !mincore(stack, pages * page, vec)) {
+        for (i = 0; i < pages && !(vec[i] & 1); ++i) {
         }
-        current = current->link;
-        if (!current) { /* If at the end of the list, wrap around.*/
-            current = state.head;
+    }
+    free(vec);
+    return (pages - i) * page;
+}
+
+static void measure(struct worker *worker, const struct thread *thread) {
+    size_t used = high_water(thread);
+
+    if (used > worker->high_water) {
+        worker->high_water = used;
+    }
+}
+
+static void unmap(struct worker *worker, struct thread *thread) {
+    measure(worker, thread);
+    munmap(thread->stack.memory, thread->stack.size);
+    thread->stack.memory = NULL;
+}
+
+/* The stacks a worker may cache, the cap is split evenly.*/
+static size_t quota(void) {
+    return (state.cap + state.n - 1) / state.n;
+}
+
+/* Takes a terminated thread that is off its stack. The stack is cached up to the
+   worker's share, the thread control block always is.*/
+static void recycle(struct worker *worker, struct thread *thread) {
+    struct pool *pool = &worker->pool;
+
+    if (pool->cached < quota()) {
+        thread->link = pool->stacks;
+        pool->stacks = thread;
+        ++pool->cached;
+    } else {
+        unmap(worker, thread);
+        thread->link = pool->threads;
+        pool->threads = thread;
+    }
+}
+
+/* A cached thread whose stack has the given layout, else one without a stack.*/
+static struct thread *reuse(struct pool *pool, size_t size, size_t guard) {
+    struct thread **link = &pool->stacks;
+    struct thread *thread;
+
+    while ((thread = *link)) {
+        if (thread->stack.size == size && thread->stack.guard == guard) {
+            *link = thread->link;
+            --pool->cached;
+            return thread;
         }
-    } while (current != start); 
+        link = &thread->link;
+    }
+    if ((thread = pool->threads)) {
+        pool->threads = thread->link;
+    }
+    return thread;
+}
+
+/* From this worker's pool, or from any pool when called outside scheduler_execute(),
+   else a new one. NULL when out of memory.*/
+static struct thread *allocate(struct worker *worker, size_t size, size_t guard) {
+    struct thread *thread = NULL;
+    int i;
+
+    if (worker) {
+        thread = reuse(&worker->pool, size, guard);
+    }
+    for (i = 0; !worker && !thread && i < state.n; ++i) {
+        thread = reuse(&state.workers[i].pool, size, guard);
+    }
+    if (!thread && (thread = (struct thread *)malloc(sizeof(struct thread)))) {
+        thread->stack.memory = NULL;
+    }
+    return thread;
+}
+
+/* The owner holds its lock from every scheduling decision until the context it
+   switched to has settled, one atomic per switch. Other workers only try it, to take
+   threads queued behind one that never yields, see rob(). A single worker has no
+   use for it.*/
+static void lock(struct worker *worker) {
+    if (state.n < 2) {
+        return;
+    }
+    while (__atomic_exchange_n(&worker->ready.lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&worker->ready.lock, __ATOMIC_RELAXED)) {
+            sched_yield(); /* a thief, preempted while holding it */
+        }
+    }
+}
+
+static int try_lock(struct worker *worker) {
+    return !__atomic_load_n(&worker->ready.lock, __ATOMIC_RELAXED) &&
+           !__atomic_exchange_n(&worker->ready.lock, 1, __ATOMIC_ACQUIRE);
+}
+
+static void unlock(struct worker *worker) {
+    if (state.n < 2) {
+        return;
+    }
+    __atomic_store_n(&worker->ready.lock, 0, __ATOMIC_RELEASE);
+}
+
+static void enqueue(struct worker *worker, struct thread *thread) {
+    thread->link = NULL;
+    if (worker->ready.tail) {
+        worker->ready.tail->link = thread;
+    } else {
+        worker->ready.head = thread;
+    }
+    worker->ready.tail = thread;
+    ++worker->ready.n;
+}
+
+static struct thread *dequeue(struct worker *worker) {
+    struct thread *thread = worker->ready.head;
+
+    if (thread) {
+        worker->ready.head = thread->link;
+        if (!worker->ready.head) {
+            worker->ready.tail = NULL;
+        }
+        --worker->ready.n;
+    }
+    return thread;
+}
+
+/* Other workers steal from the deque without a lock. While some of them have nothing
+   to run, half of the private queue moves there, oldest first.*/
+static void share(struct worker *worker) {
+    struct thread *thread;
+    long k;
+
+    if (state.n < 2 || !__atomic_load_n(&state.hungry, __ATOMIC_RELAXED)) {
+        return;
+    }
+    for (k = (worker->ready.n + 1) / 2; k > 0; --k) {
+        thread = dequeue(worker);
+        if (deque_push(&worker->deque, thread)) {
+            enqueue(worker, thread); /* out of memory, stays private */
+            return;
+        }
+    }
+}
+
+/* Wakes a parked worker, if any, for a thread just queued; all of them once nothing
+   is left to run. No fence on this path: a parked worker that is missed wakes up
+   after PARK_NS anyway.*/
+static void notify(int all) {
+    if (__atomic_load_n(&state.parked, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&state.epoch, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &state.epoch, FUTEX_WAKE_PRIVATE, all ? state.n : 1,
+                NULL, NULL, 0);
+    }
+}
+
+/* Sleeps until notify() or for PARK_NS, whichever comes first.*/
+static void park(void) {
+    struct timespec timeout;
+    int epoch = __atomic_load_n(&state.epoch, __ATOMIC_ACQUIRE);
+
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = PARK_NS;
+    __atomic_add_fetch(&state.parked, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&state.live, __ATOMIC_ACQUIRE)) {
+        syscall(SYS_futex, &state.epoch, FUTEX_WAIT_PRIVATE, epoch, &timeout, NULL, 0);
+    }
+    __atomic_sub_fetch(&state.parked, 1, __ATOMIC_RELAXED);
+}
+
+/* Called first thing after every switch: the thread switched away from is off its
+   stack now, so it may be queued, and shared with other workers. Releases the lock
+   taken for the switch.*/
+static void settle(struct worker *worker) {
+    struct thread *thread = worker->pending;
+
+    if (thread) {
+        worker->pending = NULL;
+        if (thread->status == STATUS_TERMINATED) {
+            recycle(worker, thread);
+        } else {
+            enqueue(worker, thread);
+            share(worker);
+        }
+    }
+    unlock(worker);
+    if (thread && thread->status != STATUS_TERMINATED) {
+        notify(0);
+    }
+}
+
+/* Half of the private queue of a victim, oldest first, for when it shares nothing:
+   it only does so between switches, and its running thread may never yield. The
+   caller holds its own lock.*/
+static struct thread *rob(struct worker *worker, struct worker *victim) {
+    long k;
+
+    if (!__atomic_load_n(&victim->ready.n, __ATOMIC_RELAXED) || !try_lock(victim)) {
+        return NULL;
+    }
+    for (k = (victim->ready.n + 1) / 2; k > 0; --k) {
+        enqueue(worker, dequeue(victim));
+    }
+    unlock(victim);
+    return dequeue(worker);
+}
+
+/* The oldest ready thread of this worker, else one stolen from another worker. The
+   private queue comes first, the shared one only every 61st time: a thread shared
+   but never stolen cannot starve, and a decision mostly costs no atomics besides the
+   lock. The caller holds the lock of worker.*/
+static struct thread *thread_candidate(struct worker *worker) {
+    struct thread *thread;
+    int i, k;
+
+    /*printf("Looking for a thread candidate.\n");*/
+    if (!(++worker->ticks % 61) &&
+        !deque_empty(&worker->deque) &&
+        (thread = (struct thread *)deque_steal(&worker->deque))) {
+        return thread;
+    }
+    if ((thread = dequeue(worker))) {
+        return thread;
+    }
+    if (!deque_empty(&worker->deque) &&
+        (thread = (struct thread *)deque_steal(&worker->deque))) {
+        return thread;
+    }
+    if (state.n > 1) {
+        /* Victims in a random rotation, so that thieves spread out.*/
+        worker->seed = worker->seed * 6364136223846793005UL + 1442695040888963407UL;
+        k = (int)((worker->seed >> 33) % (unsigned long)state.n);
+        for (i = 0; i < state.n; ++i) {
+            struct worker *victim = &state.workers[(k + i) % state.n];
 
+            if (victim != worker &&
+                ((thread = (struct thread *)deque_steal(&victim->deque)) ||
+                 (thread = rob(worker, victim)))) {
+                return thread;
+            }
+        }
+    }
     return NULL;
 }
 
 
+static void start(void);
+
+/* Makes the first size bytes of a stack fault on access. Guard regions are part of
+   the stack's mapping, where the kernel has them, so that a process is not limited
+   by vm.max_map_count to about 32k guarded threads; else the guard is mprotect()ed
+   into a mapping of its own.*/
+static int protect_guard(void *memory, size_t size) {
+    if (!__atomic_load_n(&state.split, __ATOMIC_RELAXED)) {
+        if (!madvise(memory, size, MADV_GUARD_INSTALL)) {
+            return 0;
+        }
+        if (errno != EINVAL) {
+            return -1;
+        }
+        __atomic_store_n(&state.split, 1, __ATOMIC_RELAXED);
+    }
+    return mprotect(memory, size, PROT_NONE);
+}
+
+/* Why a stack could not be mapped.*/
+static void stack_error(const char *what) {
+    if (errno == ENOMEM) {
+        printf("%s: out of memory or of mappings (vm.max_map_count).\n", what);
+    } else {
+        printf("%s.\n", what);
+    }
+}
+
+void scheduler_attr_init(struct scheduler_attr *attr) {
+    attr->stack_size = SCHEDULER_STACK_SIZE;
+    attr->guard_size = page_size();
+}
+
+
 int scheduler_create(scheduler_fnc_t fnc, void *arg) {
-    struct thread *new_thread = (struct thread *)malloc(sizeof(struct thread));
-    int stack_size;
+    return scheduler_create_attr(fnc, arg, NULL);
+}
+
+
+int scheduler_create_attr(scheduler_fnc_t fnc, void *arg, const struct scheduler_attr *attr) {
+    struct worker *worker = self;
+    struct pool *pool;
+    struct thread *new_thread;
+    struct scheduler_attr defaults;
+    size_t page = page_size();
+    size_t stack_size;
+    size_t guard;
     /*printf("Creating a new thread.\n");*/
-    
+
+    if (setup()) {
+        return -1;
+    }
+
+    if (!attr) {
+        scheduler_attr_init(&defaults);
+        attr = &defaults;
+    }
+
+    /* Both sizes in whole pages, the stack at least one.*/
+    stack_size = (attr->stack_size + page - 1) / page * page;
+    stack_size = stack_size ? stack_size : page;
+    guard = (attr->guard_size + page - 1) / page * page;
+
+    new_thread = allocate(worker, guard + stack_size, guard);
     if (!new_thread) {
         printf("Failed to allocate memory for new thread.\n");
         return -1;
@@ -107,27 +480,58 @@ int scheduler_create(scheduler_fnc_t fnc, void *arg) {
     new_thread->function = fnc;
     new_thread->args = arg;
 
-    stack_size = page_size();
-    new_thread->stack.memory_ = malloc(stack_size);
-    if (!new_thread->stack.memory_) {
-        printf("Failed to allocate memory for new thread's stack.\n");
-        free(new_thread);
-        return -1;
+    /* A failed mapping leaves the thread control block in a pool.*/
+    pool = worker ? &worker->pool : &state.workers[0].pool;
+    if (!new_thread->stack.memory) {
+        new_thread->stack.guard = guard;
+        new_thread->stack.size = guard + stack_size;
+
+        /* Reserved, not committed: a page costs memory once the thread touches it.*/
+        new_thread->stack.memory = mmap(NULL, new_thread->stack.size,
+                                        PROT_READ | PROT_WRITE,
+                                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                                        -1, 0);
+        if (MAP_FAILED == new_thread->stack.memory) {
+            stack_error("Failed to allocate memory for new thread's stack");
+            new_thread->stack.memory = NULL;
+            new_thread->link = pool->threads;
+            pool->threads = new_thread;
+            return -1;
+        }
+
+        /* The guard sits below the stack, an overflow faults instead of corrupting memory.*/
+        if (guard && protect_guard(new_thread->stack.memory, guard)) {
+            stack_error("Failed to protect new thread's stack guard");
+            munmap(new_thread->stack.memory, new_thread->stack.size);
+            new_thread->stack.memory = NULL;
+            new_thread->link = pool->threads;
+            pool->threads = new_thread;
+            return -1;
+        }
     }
 
-    /* Align the memory to the required page size.*/
-    new_thread->stack.memory = memory_align(new_thread->stack.memory_, stack_size);
+    context_init(&new_thread->ctx,
+                 (char *)new_thread->stack.memory + new_thread->stack.guard,
+                 stack_size,
+                 start);
 
-    /* If no head exists, this is the first thread.*/
-    if (!state.head) {
-        state.head = new_thread;
-        new_thread->link = new_thread; /* Point to itself to form a circular list.*/
-    } 
-    else {
-        /* Attach new thread to the beginning, but adjust links to keep it circular.*/
-        new_thread->link = state.head->link;
-        state.head->link = new_thread;
-        state.head = new_thread;
+    __atomic_add_fetch(&state.live, 1, __ATOMIC_ACQ_REL);
+    if (worker) {
+        /* From a user thread: ready at once, on this worker.*/
+        lock(worker);
+        enqueue(worker, new_thread);
+        share(worker);
+        unlock(worker);
+        notify(0);
+    } else {
+        /* Dealt to the workers by scheduler_execute(), in creation order.*/
+        new_thread->link = NULL;
+        if (state.tail) {
+            state.tail->link = new_thread;
+        } else {
+            state.head = new_thread;
+        }
+        state.tail = new_thread;
     }
 
     /*printf("Thread created successfully.\n");*/
@@ -135,61 +539,196 @@ int scheduler_create(scheduler_fnc_t fnc, void *arg) {
 }
 
 
-static void schedule(void) {
-    struct thread *candidate = thread_candidate();
-    uint64_t rsp;
-    /*printf("Scheduling next thread.\n");*/
+/* Leaves the current context, from, for next or for the worker loop if next is NULL.
+   prev, if any, is settled by whoever runs next. Returns when from is resumed,
+   possibly on another worker.*/
+static void switch_to(struct worker *worker,
+                      struct context *from,
+                      struct thread *prev,
+                      struct thread *next) {
+    worker->pending = prev;
+    if (next) {
+        next->status = STATUS_RUNNING;
+        next->worker = worker;
+        worker->thread = next;
+        swap_context(from, &next->ctx);
+    } else {
+        worker->thread = NULL;
+        swap_context(from, &worker->ctx);
+    }
+}
 
-    if (candidate) {
 
-        state.thread = candidate;
+/* Every thread starts here, on its own stack, and never returns.*/
+static void start(void) {
+    struct thread *current = self->thread;
+    struct worker *worker;
 
-        if (candidate->status == STATUS_) {
-            /*printf("Starting a new thread.\n");*/
-            candidate->status = STATUS_RUNNING;
+    settle(current->worker);
+    current->function(current->args);
+    worker = current->worker;
+    current->status = STATUS_TERMINATED;
+    if (!__atomic_sub_fetch(&state.live, 1, __ATOMIC_ACQ_REL)) {
+        notify(1); /* the last one, parked workers may leave */
+    }
+    /*printf("Thread terminated.\n");*/
+    lock(worker);
+    switch_to(worker, &current->ctx, current, thread_candidate(worker));
+    EXIT("software"); /* a terminated thread is never resumed */
+}
+
+
+/* A worker runs ready threads until every thread has terminated. Without any, it
+   yields the CPU SPINS times and then parks until there is work.*/
+static void run(struct worker *worker) {
+    struct thread *thread;
+    int hungry = 0;
+    int idle = 0;
 
-            rsp = (uint64_t)candidate->stack.memory + page_size();
-            __asm__ volatile("mov %[rs], %%rsp \n" : [rs] "+r" (rsp) : );
-            candidate->function(candidate->args);
-            
-            candidate->status = STATUS_TERMINATED;
-            /*printf("Thread terminated.\n");*/
-            longjmp(state.ctx, 1);  
+    self = worker;
+    for (;;) {
+        lock(worker);
+        if ((thread = thread_candidate(worker))) {
+            if (hungry) {
+                hungry = 0;
+                __atomic_sub_fetch(&state.hungry, 1, __ATOMIC_RELAXED);
+            }
+            idle = 0;
+            switch_to(worker, &worker->ctx, NULL, thread);
+            settle(worker);
+            continue;
+        }
+        unlock(worker);
+        if (!__atomic_load_n(&state.live, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        /* The others hold the rest, ask them to share.*/
+        if (!hungry) {
+            hungry = 1;
+            __atomic_add_fetch(&state.hungry, 1, __ATOMIC_RELAXED);
+        }
+        if (++idle < SPINS) {
+            sched_yield();
         } else {
-            /*printf("Resuming a sleeping thread.\n");*/
-            candidate->status = STATUS_RUNNING;
-            longjmp(candidate->ctx, 1);
+            park();
         }
     }
+    if (hungry) {
+        __atomic_sub_fetch(&state.hungry, 1, __ATOMIC_RELAXED);
+    }
+    self = NULL;
+}
+
+static void *worker_main(void *arg) {
+    run((struct worker *)arg);
+    return NULL;
 }
 
 
 void scheduler_execute(void) {
-    int jmp_val;
-    printf("Executing scheduler.\n");
-    
-    jmp_val = setjmp(state.ctx);
-    if (jmp_val == 0 || jmp_val == 1) {
-        schedule();
-    } 
-    destroy();
+    struct thread *thread;
+    int i, started;
+
+    if (setup()) {
+        return;
+    }
+    if (!state.head) {
+        printf("No threads to run.\n");
+        return;
+    }
+
+    /* Round robin over the workers, none is running yet.*/
+    for (i = 0; (thread = state.head); i = (i + 1) % state.n) {
+        state.head = thread->link;
+        enqueue(&state.workers[i], thread);
+    }
+    state.tail = NULL;
+    for (i = 0; i < state.n; ++i) {
+        state.workers[i].high_water = 0;
+    }
+
+    /* The calling thread is the first worker. One that fails to start is no loss,
+       the others steal its threads.*/
+    for (started = 1; started < state.n; ++started) {
+        if (pthread_create(&state.workers[started].pthread,
+                           NULL,
+                           worker_main,
+                           &state.workers[started])) {
+            printf("Failed to start worker %d.\n", started);
+            break;
+        }
+    }
+    run(&state.workers[0]);
+    for (i = 1; i < started; ++i) {
+        pthread_join(state.workers[i].pthread, NULL);
+    }
+    for (i = 0; i < state.n; ++i) {
+        deque_reclaim(&state.workers[i].deque);
+    }
 }
 
 void scheduler_yield() {
+    struct worker *worker = self;
+    struct thread *current;
     struct thread *candidate;
     /*printf("Yielding current thread.\n");*/
 
-    if (setjmp(state.thread->ctx) == 0) {
-        
-        candidate = thread_candidate();
+    if (!worker || !(current = worker->thread)) {
+        return;
+    }
+    lock(worker);
+    candidate = thread_candidate(worker);
+    if (!candidate) {
+        /* Nothing else is ready, keep running.*/
+        unlock(worker);
+        return;
+    }
 
-        if (!candidate) {
-            printf("No thread candidate to yield to.\n");
-            return;
+    /* Straight to the candidate, the worker loop is not involved.*/
+    current->status = STATUS_SLEEPING;
+    switch_to(worker, &current->ctx, current, candidate);
+    settle(current->worker);
+}
+
+size_t scheduler_stack_high_water(void) {
+    struct worker *worker;
+    struct thread *thread;
+    size_t high = 0;
+    int i;
+
+    for (i = 0; i < state.n; ++i) {
+        worker = &state.workers[i];
+        /* Cached stacks keep their pages, so their marks are read only now.*/
+        for (thread = worker->pool.stacks; thread; thread = thread->link) {
+            measure(worker, thread);
+        }
+        if (worker->high_water > high) {
+            high = worker->high_water;
         }
+    }
+    return high;
+}
+
+void scheduler_stack_cache(size_t n) {
+    struct pool *pool;
+    struct thread *thread;
+    int i;
 
-        state.thread->status = STATUS_SLEEPING;
-        /*printf("Current thread set to sleeping. Jumping back to scheduler_execute.\n");*/
-        longjmp(state.ctx, 1);
+    state.cap = n;
+    for (i = 0; i < state.n; ++i) {
+        pool = &state.workers[i].pool;
+        /* Only the stack goes, as in recycle(), and its mark is kept.*/
+        while (pool->cached > quota()) {
+            thread = pool->stacks;
+            pool->stacks = thread->link;
+            --pool->cached;
+            unmap(&state.workers[i], thread);
+            thread->link = pool->threads;
+            pool->threads = thread;
+        }
+        while (!n && (thread = pool->threads)) {
+            pool->threads = thread->link;
+            free(thread);
+        }
     }
 }
@@ -10,6 +10,20 @@
 #ifndef _SCHEDULER_H_
 #define _SCHEDULER_H_
 
+#include <stddef.h>
+
+/**
+ * The default stack size of a user thread, in bytes.
+ */
+
+#define SCHEDULER_STACK_SIZE (64 * 1024)
+
+/**
+ * The default number of stacks kept for reuse, see scheduler_stack_cache().
+ */
+
+#define SCHEDULER_STACK_CACHE 256
+
 /**
  * scheduler_fnc_t defines the signature of the user thread function to
  * be scheduled by the scheduler. The user thread function will be supplied
@@ -19,7 +33,8 @@
 typedef void (*scheduler_fnc_t)(void *arg);
 
 /**
- * Creates a new user thread.
+ * Creates a new user thread. Called from within a user thread, the new
+ * one is ready at once.
  *
  * fnc: the start function of the user thread (see scheduler_fnc_t)
  * arg: a pass-through pointer defining the context of the user thread
@@ -29,6 +44,44 @@ typedef void (*scheduler_fnc_t)(void *arg);
 
 int scheduler_create(scheduler_fnc_t fnc, void *arg);
 
+/**
+ * Attributes of a user thread, see scheduler_attr_init().
+ *
+ * stack_size: the usable stack in bytes, rounded up to whole pages
+ * guard_size: the inaccessible bytes below the stack, rounded up to whole
+ *             pages, 0 for none
+ *
+ * Stacks are mapped, not allocated: a stack page costs memory only once
+ * the thread touches it, so a generous stack_size is cheap. A guard turns
+ * an overflow into a segmentation fault. Since Linux 6.13 it lives inside
+ * the stack's mapping; older kernels split every guarded stack into two
+ * mappings, and the number of mappings of a process is capped by
+ * vm.max_map_count (65530 by default), so past about 32k threads there
+ * scheduler_create() fails unless the guard is off or that limit raised.
+ */
+
+struct scheduler_attr {
+	size_t stack_size;
+	size_t guard_size;
+};
+
+/**
+ * Sets attr to the defaults: a SCHEDULER_STACK_SIZE stack and a one page
+ * guard.
+ */
+
+void scheduler_attr_init(struct scheduler_attr *attr);
+
+/**
+ * Same as scheduler_create(), with the attributes of the new user thread.
+ *
+ * attr: copied, NULL for the defaults
+ */
+
+int scheduler_create_attr(scheduler_fnc_t fnc,
+			  void *arg,
+			  const struct scheduler_attr *attr);
+
 /**
  * Called to execute the user threads previously created by calling
  * scheduler_create().
@@ -39,14 +92,54 @@ int scheduler_create(scheduler_fnc_t fnc, void *arg);
  *   * This function returns after all user threads (previously created)
  *     have terminated.
  *   * This function is not re-enterant.
+ *   * The user threads run in parallel on a set of kernel threads, the
+ *     workers: the SCHEDULER_WORKERS environment variable, read once,
+ *     or one per CPU. The calling thread is one of them. Each worker
+ *     runs its own threads in FIFO order and, when it has none, steals
+ *     from the others, so a user thread may resume on another worker
+ *     than the one it yielded on. A worker with nothing to steal sleeps
+ *     until another one has work to spare.
  */
 
 void scheduler_execute(void);
 
 /**
  * Called from within a user thread to yield the CPU to another user thread.
+ * Returns at once if no other user thread is ready.
  */
 
 void scheduler_yield(void);
 
+/**
+ * Reports the deepest stack use over the user threads of the last
+ * scheduler_execute(), to help size scheduler_attr.stack_size. Call it
+ * before the next scheduler_create(). Measured by the pages the threads
+ * made resident, so it is page granular and counts a page swapped out
+ * since as unused.
+ *
+ * A cached stack (see scheduler_stack_cache()) keeps its pages, so the
+ * mark also covers earlier threads that ran on a stack taken from the
+ * cache.
+ *
+ * return: the stack high-water mark in bytes, 0 before any execution
+ */
+
+size_t scheduler_stack_high_water(void);
+
+/**
+ * A terminated user thread is reclaimed at the next scheduling decision,
+ * and scheduler_create() reuses it: its control block always, its stack
+ * if the attributes match and at most n stacks are cached. A cached
+ * stack saves the mapping system calls and the page faults of a fresh
+ * one, at the price of the pages it keeps resident. Each worker caches
+ * its share of n, the threads that terminated on it.
+ *
+ * n: the most stacks to cache, lowering it releases the excess at once,
+ *    0 also frees every cached control block
+ *
+ * Note: not to be called during scheduler_execute()
+ */
+
+void scheduler_stack_cache(size_t n);
+
 #endif /* _SCHEDULER_H_ */
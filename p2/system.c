@@ -15,6 +15,7 @@
 /**
  * Needs:
  *   nanosleep()
+ *   clock_gettime()
  *   unlink()
  *   vsnprintf()
  *   sysconf()
@@ -32,6 +33,17 @@ us_sleep(uint64_t us)
 	}
 }
 
+uint64_t
+time_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+		EXIT("clock_gettime()");
+	}
+	return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
 void
 file_delete(const char *pathname)
 {
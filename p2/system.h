@@ -55,6 +55,12 @@
 
 void us_sleep(uint64_t us);
 
+/**
+ * return: a monotonic timestamp in nanoseconds
+ */
+
+uint64_t time_ns(void);
+
 void file_delete(const char *pathname);
 
 void safe_sprintf(char *buf, size_t len, const char *format, ...);